@@ -0,0 +1,64 @@
+#include "background.h"
+
+BackgroundModel::BackgroundModel() {
+    reset();
+}
+
+void BackgroundModel::reset() {
+    _count = 0;
+    _echoes = 0;
+    _mean = 0;
+    _variance = 0;
+    _timeoutRate = 0;
+}
+
+// running mean/variance (Welford) until BACKGROUND_MEMORY samples, exponentially weighted afterwards
+void BackgroundModel::add(float distance) {
+    _count++;
+    float weight = 1.0f / min(_count, (uint32_t)BACKGROUND_MEMORY);
+    _timeoutRate += ((distance < 0 ? 1.0f : 0.0f) - _timeoutRate) * weight;
+    if (distance < 0) {
+        return;
+    }
+    _echoes++;
+    weight = 1.0f / min(_echoes, (uint32_t)BACKGROUND_MEMORY);
+    float delta = distance - _mean;
+    _mean += delta * weight;
+    _variance = (1 - weight) * (_variance + weight * delta * delta);
+}
+
+bool BackgroundModel::isReady() {
+    return _count >= BACKGROUND_WARMUP;
+}
+
+bool BackgroundModel::hasSurface() {
+    return _echoes >= BACKGROUND_WARMUP / 2 && _timeoutRate <= BACKGROUND_SURFACE_RATE;
+}
+
+float BackgroundModel::getArriveThreshold() {
+    return _mean - max((float)(BACKGROUND_SIGMAS * sqrtf(_variance)), (float)(BACKGROUND_MARGIN * _mean));
+}
+
+// open field - every echo is learned, the timeout rate decides whether a surface appeared
+bool BackgroundModel::isConsistent(float distance) {
+    if (!isReady() || distance < 0) {
+        return true;
+    }
+    return !hasSurface() || distance >= getArriveThreshold();
+}
+
+float BackgroundModel::getMean() {
+    return _mean;
+}
+
+float BackgroundModel::getDeviation() {
+    return sqrtf(_variance);
+}
+
+float BackgroundModel::getTimeoutRate() {
+    return _timeoutRate;
+}
+
+uint32_t BackgroundModel::getCount() {
+    return _count;
+}
@@ -0,0 +1,57 @@
+#ifndef background_h
+#define background_h
+
+#include <Arduino.h>
+
+#define BACKGROUND_WARMUP 50         // samples before the model is used
+#define BACKGROUND_MEMORY 200        // samples, the model follows slow changes (exponential forgetting)
+#define BACKGROUND_SIGMAS 4.0        // deviation from the mean considered significant
+#define BACKGROUND_MARGIN 0.1        // minimum relative deviation, covers the sensor nonlinearity
+#define BACKGROUND_SURFACE_RATE 0.5  // timeout rate up to which there is a surface to compare against
+
+/**
+ * Empty scene seen by one sensor - mean and variance of the echo distance and the rate of the
+ * missing echoes, learned while no object is in front of the sensor.
+ *
+ * An object is present when it is significantly closer than the background. An open field (echoes
+ * missing most of the time) has no surface to compare against, the configured threshold applies then.
+ */
+class BackgroundModel {
+   public:
+    BackgroundModel();
+    void reset();
+
+    /**
+     * @brief Adds a sample of the empty scene.
+     *
+     * @param distance [cm], negative for a missing echo
+     */
+    void add(float distance);
+
+    /**
+     * @brief The sample fits the background (always true before the model is ready).
+     */
+    bool isConsistent(float distance);
+
+    bool isReady();
+    bool hasSurface();
+
+    /**
+     * @brief [cm] closer than that is a significant deviation, valid when ready with a surface.
+     */
+    float getArriveThreshold();
+
+    float getMean();
+    float getDeviation();
+    float getTimeoutRate();
+    uint32_t getCount();
+
+   private:
+    uint32_t _count;
+    uint32_t _echoes;
+    float _mean;      // [cm]
+    float _variance;  // [cm^2]
+    float _timeoutRate;
+};
+
+#endif
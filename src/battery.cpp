@@ -1,58 +1,113 @@
 #include "battery.h"
 
-#define ANALOG_BATTERY_PIN 36
+#include <driver/adc.h>
+
+#include "logging.h"
+#include "timebase.h"
+
+#define ANALOG_BATTERY_CHANNEL ADC1_CHANNEL_0  // GPIO36
+
+#define BATTERY_TABLE_MIN 3600   // [mV] first table entry, cutoff of the device (the old raw value 127)
+#define BATTERY_TABLE_STEP 50    // [mV] between the table entries
 
 /*
 Battery measurement
-read analog value >> 4 (highest 8 bits) gives us a number 0-255.
-
-Because of different ADC and resistors, we have 127/125 for 3.6V.
-The device stops to work on the value 127.
-
-Table with my battery observations
-        1(Red)        2(White)
-USB disconnected, battery (discharged - 3.6V) connected
-        127         125
-USB connected, battery disconnected
-        148+        142+
-USB connected, battery (discharged) connected
-        139         134
-USB disconnected, battery (charged - 4.15 / 4.13V) connected
-        147         145
+
+The ADC is read through the eFuse calibration (two point or Vref, whichever the chip has) at 11dB
+attenuation and the 1M/1M divider of the FireBeetle is multiplied back.
+
+Usable charge of a single Li-ion cell under the light load of the device, [permille] every 50mV
+from the 3.60V cutoff to 4.20V. The remaining runtime counts down to the cutoff as well.
 */
+static const uint16_t batteryLevels[] = {
+    0,    // 3.60V
+    70,   // 3.65V
+    163,  // 3.70V
+    267,  // 3.75V
+    360,  // 3.80V
+    453,  // 3.85V
+    547,  // 3.90V
+    640,  // 3.95V
+    721,  // 4.00V
+    802,  // 4.05V
+    884,  // 4.10V
+    953,  // 4.15V
+    1000  // 4.20V
+};
+
+#define BATTERY_TABLE_SIZE (sizeof(batteryLevels) / sizeof(batteryLevels[0]))
+#define BATTERY_TABLE_MAX (BATTERY_TABLE_MIN + (BATTERY_TABLE_SIZE - 1) * BATTERY_TABLE_STEP)
+
 Battery::Battery() {
+    _filtered = 0;
+    _initialized = false;
+    _referenceTime = 0;
+    _referenceLevel = 0;
+    _lastTime = 0;
+    _lastLevel = 0;
+}
+
+void Battery::init() {
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten(ANALOG_BATTERY_CHANNEL, ADC_ATTEN_DB_11);
+    esp_adc_cal_value_t calibration =
+        esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, BATTERY_DEFAULT_VREF, &_characteristics);
+    Log.infoln("Battery ADC calibration %s", calibration == ESP_ADC_CAL_VAL_EFUSE_TP     ? "two point"
+                                             : calibration == ESP_ADC_CAL_VAL_EFUSE_VREF ? "eFuse Vref"
+                                                                                         : "default Vref");
 }
 
 void Battery::update() {
-    _value = analogRead(ANALOG_BATTERY_PIN) >> 4;  // 8bits more than enough
+    uint32_t raw = 0;
+    for (uint8_t i = 0; i < BATTERY_OVERSAMPLING; i++) {
+        raw += adc1_get_raw(ANALOG_BATTERY_CHANNEL);
+    }
+    uint32_t voltage = esp_adc_cal_raw_to_voltage(raw / BATTERY_OVERSAMPLING, &_characteristics) * BATTERY_DIVIDER;
+    if (!_initialized) {
+        _filtered = voltage << BATTERY_FILTER_SHIFT;
+        _initialized = true;
+    } else {
+        _filtered = _filtered - (_filtered >> BATTERY_FILTER_SHIFT) + voltage;
+    }
+
+    // discharge observation, restarted when the level rises (charging)
+    _lastTime = nowMicros() / (1000 * MICROS_PER_MILLI);
+    _lastLevel = computeLevel(getVoltage());
+    if (_referenceTime == 0 || _lastLevel > _referenceLevel + BATTERY_CHARGING_RISE) {
+        _referenceTime = max(_lastTime, (uint32_t)1);
+        _referenceLevel = _lastLevel;
+    }
 }
 
-uint8_t Battery::getValue() {
-    return _value;
+uint16_t Battery::getVoltage() {
+    return _filtered >> BATTERY_FILTER_SHIFT;
 }
 
 int Battery::getPercentage() {
-//     Serial.println("***********");
-//     Serial.print("145: ");
-//     Serial.println(computePercentage(145));
-
-//     Serial.print("134: ");
-//     Serial.println(computePercentage(134));
-
-//     Serial.print("125: ");
-//     Serial.println(computePercentage(125));
+    return getLevel() / 10;
+}
 
-//     Serial.print(getValue());
-//     Serial.print(": ");
-//     Serial.println(computePercentage(getValue()));
+uint16_t Battery::getLevel() {
+    return _lastLevel;
+}
 
-//     Serial.println("***********");
-    return computePercentage(getValue());
+int32_t Battery::getRemainingRuntime() {
+    uint32_t elapsed = _lastTime - _referenceTime;
+    if (_referenceTime == 0 || elapsed < BATTERY_RATE_MIN_TIME || _lastLevel + BATTERY_RATE_MIN_DROP > _referenceLevel) {
+        return BATTERY_RUNTIME_UNKNOWN;
+    }
+    return (int64_t)_lastLevel * elapsed / (_referenceLevel - _lastLevel);
 }
 
-int Battery::computePercentage(uint8_t value) {
-    float u = value * 4.20 / 145;       //4.20 is faked a little 
-    float p = 123 - (123 / pow(1 + pow(u / 3.7, 80), 0.165));
-    int r = floor(p);
-    return min(r, 100);
-}
\ No newline at end of file
+// table lookup with linear interpolation between the 50mV steps
+uint16_t Battery::computeLevel(uint16_t voltage) {
+    if (voltage <= BATTERY_TABLE_MIN) {
+        return batteryLevels[0];
+    }
+    if (voltage >= BATTERY_TABLE_MAX) {
+        return batteryLevels[BATTERY_TABLE_SIZE - 1];
+    }
+    uint16_t index = (voltage - BATTERY_TABLE_MIN) / BATTERY_TABLE_STEP;
+    uint16_t offset = (voltage - BATTERY_TABLE_MIN) % BATTERY_TABLE_STEP;
+    return batteryLevels[index] + (batteryLevels[index + 1] - batteryLevels[index]) * offset / BATTERY_TABLE_STEP;
+}
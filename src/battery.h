@@ -2,18 +2,63 @@
 #define battery_h
 
 #include <Arduino.h>
+#include <esp_adc_cal.h>
 
+#define BATTERY_OVERSAMPLING 16        // raw ADC reads averaged per sample
+#define BATTERY_FILTER_SHIFT 3         // exponential filter weight 1/8 of the new sample
+#define BATTERY_DIVIDER 2              // on-board 1M/1M voltage divider
+#define BATTERY_DEFAULT_VREF 1100      // [mV] used when the eFuse has no calibration
+#define BATTERY_RATE_MIN_TIME 600      // [s] discharge observed before the runtime is estimated
+#define BATTERY_RATE_MIN_DROP 10       // [permille] discharge observed before the runtime is estimated
+#define BATTERY_CHARGING_RISE 20       // [permille] rise treated as charging, restarts the observation
+#define BATTERY_RUNTIME_UNKNOWN -1
+
+/**
+ * Battery gauge - calibrated, oversampled and filtered voltage, state of charge from a lookup table
+ * and the remaining runtime from the discharge rate observed since power-on (or the last charging).
+ * Integer arithmetic only, cheap enough to sample every second.
+ */
 class Battery {
    public:
     Battery();
+    void init();
 
+    /**
+     * @brief Takes one oversampled reading into the filter.
+     */
     void update();
-    uint8_t getValue();
+
+    /**
+     * @brief Filtered battery voltage [mV].
+     */
+    uint16_t getVoltage();
+
+    /**
+     * @brief State of charge [%], 0 at the cutoff voltage.
+     */
     int getPercentage();
 
+    /**
+     * @brief State of charge [permille].
+     */
+    uint16_t getLevel();
+
+    /**
+     * @brief Remaining runtime [s] or BATTERY_RUNTIME_UNKNOWN before enough discharge was observed.
+     */
+    int32_t getRemainingRuntime();
+
    private:
-    uint8_t _value;
-    int computePercentage(uint8_t value);
+    esp_adc_cal_characteristics_t _characteristics;
+    uint32_t _filtered;  // [mV << BATTERY_FILTER_SHIFT]
+    bool _initialized;
+
+    uint32_t _referenceTime;  // [s] start of the discharge observation
+    uint16_t _referenceLevel;
+    uint32_t _lastTime;  // [s]
+    uint16_t _lastLevel;
+
+    static uint16_t computeLevel(uint16_t voltage);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,110 @@
+#include "benchmark.h"
+
+LinkBenchmark::LinkBenchmark() {
+    _running = false;
+    _rate = BENCHMARK_DEFAULT_RATE;
+    _size = BENCHMARK_DEFAULT_SIZE;
+    _count = BENCHMARK_DEFAULT_COUNT;
+}
+
+void LinkBenchmark::start(uint16_t rate, uint16_t size, uint16_t count) {
+    _rate = constrain(rate, 1, 1000);
+    _size = size;
+    _count = count;
+    _sent = 0;
+    _received = 0;
+    _sendFailures = 0;
+    _queueOverflows = 0;
+    _minRoundTrip = INT64_MAX;
+    _maxRoundTrip = 0;
+    memset(_histogram, 0, sizeof(_histogram));
+    _running = true;
+}
+
+bool LinkBenchmark::isRunning() {
+    return _running;
+}
+
+bool LinkBenchmark::isPingDue() {
+    return _running && _sent < _count;
+}
+
+void LinkBenchmark::onPingSent() {
+    _sent++;
+}
+
+void LinkBenchmark::onPong(int64_t roundTrip) {
+    if (!_running) {
+        return;
+    }
+    _received++;
+    _minRoundTrip = min(_minRoundTrip, roundTrip);
+    _maxRoundTrip = max(_maxRoundTrip, roundTrip);
+    _histogram[min((int64_t)BENCHMARK_BUCKETS - 1, roundTrip / BENCHMARK_BUCKET_WIDTH)]++;
+}
+
+void LinkBenchmark::onSendFailure() {
+    if (_running) {
+        _sendFailures++;
+    }
+}
+
+void LinkBenchmark::onQueueOverflow() {
+    if (_running) {
+        _queueOverflows++;
+    }
+}
+
+uint16_t LinkBenchmark::getRate() {
+    return _rate;
+}
+
+uint16_t LinkBenchmark::getSize() {
+    return _size;
+}
+
+// upper bound of the bucket containing the given percentile
+int64_t LinkBenchmark::percentile(uint8_t prct) {
+    uint32_t threshold = (_received * prct + 99) / 100;
+    uint32_t cumulative = 0;
+    for (int i = 0; i < BENCHMARK_BUCKETS; i++) {
+        cumulative += _histogram[i];
+        if (cumulative >= threshold) {
+            return min((int64_t)(i + 1) * BENCHMARK_BUCKET_WIDTH, _maxRoundTrip);
+        }
+    }
+    return _maxRoundTrip;
+}
+
+void LinkBenchmark::finish(Print *output) {
+    _running = false;
+    output->printf("Link benchmark: %u pings at %u Hz, %u B\r\n", _sent, _rate, _size);
+    if (_received == 0) {
+        output->printf("  no pong received, loss 100%%\r\n");
+    } else {
+        output->printf("  rtt min %lld us, p50 <%lld us, p99 <%lld us, max %lld us\r\n", _minRoundTrip, percentile(50), percentile(99), _maxRoundTrip);
+        output->printf("  loss %u/%u (%.1f%%)\r\n", _sent - _received, _sent, 100.0 * (_sent - _received) / _sent);
+        uint32_t maxCount = 0;
+        for (int i = 0; i < BENCHMARK_BUCKETS; i++) {
+            maxCount = max(maxCount, _histogram[i]);
+        }
+        for (int i = 0; i < BENCHMARK_BUCKETS; i++) {
+            if (_histogram[i] == 0) {
+                continue;
+            }
+            char bar[41];
+            uint8_t length = (uint8_t)((_histogram[i] * 40 + maxCount - 1) / maxCount);
+            memset(bar, '#', length);
+            bar[length] = 0;
+            if (i == BENCHMARK_BUCKETS - 1) {
+                output->printf("  >=%6d us %6u %s\r\n", i * BENCHMARK_BUCKET_WIDTH, _histogram[i], bar);
+            } else {
+                output->printf("  < %6d us %6u %s\r\n", (i + 1) * BENCHMARK_BUCKET_WIDTH, _histogram[i], bar);
+            }
+        }
+    }
+    output->printf("  send callback failures %u\r\n", _sendFailures);
+    if (_queueOverflows > 0) {
+        output->printf("  WARNING: %u queue overflows, results are not reliable\r\n", _queueOverflows);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef benchmark_h
+#define benchmark_h
+
+#include <Arduino.h>
+
+#define BENCHMARK_BUCKET_WIDTH 500     // [us] histogram resolution
+#define BENCHMARK_BUCKETS 64           // last bucket collects everything above
+#define BENCHMARK_DRAIN_TIME 1000      // [ms] how long to wait for late pongs
+#define BENCHMARK_DEFAULT_RATE 20      // [Hz]
+#define BENCHMARK_DEFAULT_SIZE 32      // [B]
+#define BENCHMARK_DEFAULT_COUNT 500
+
+/**
+ * Link round trip benchmark.
+ *
+ * Collects round trips of ping/pong frames travelling the whole path - send queue, esp_now_send,
+ * peer receive task, peer state machine queue and back - and reports their histogram.
+ */
+class LinkBenchmark {
+   public:
+    LinkBenchmark();
+
+    /**
+     * @brief Starts a new benchmark, previous results are discarded.
+     *
+     * @param rate pings per second
+     * @param size frame size in bytes (padded up to the message size at least)
+     * @param count number of pings
+     */
+    void start(uint16_t rate, uint16_t size, uint16_t count);
+    bool isRunning();
+    bool isPingDue();
+
+    void onPingSent();
+    void onPong(int64_t roundTrip);
+    void onSendFailure();
+    void onQueueOverflow();
+
+    uint16_t getRate();
+    uint16_t getSize();
+
+    /**
+     * @brief Stops the benchmark and prints the results.
+     */
+    void finish(Print *output);
+
+   private:
+    volatile bool _running;
+    uint16_t _rate;
+    uint16_t _size;
+    uint16_t _count;
+
+    uint32_t _sent;
+    uint32_t _received;
+    uint32_t _sendFailures;
+    uint32_t _queueOverflows;
+    int64_t _minRoundTrip;
+    int64_t _maxRoundTrip;
+    uint32_t _histogram[BENCHMARK_BUCKETS];
+
+    int64_t percentile(uint8_t prct);
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "clocksync.h"
+
+ClockSync::ClockSync() {
+    _sampleIdx = 0;
+    _sampleCount = 0;
+    _refTime = 0;
+    _offset = 0;
+    _drift = 0;
+    _roundTrip = 0;
+    _synchronized = false;
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void ClockSync::addSample(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+    ClockSyncSample sample;
+    sample.roundTrip = (t4 - t1) - (t3 - t2);
+    if (sample.roundTrip < 0) {
+        return;  // corrupted exchange
+    }
+    sample.offset = ((t2 - t1) + (t3 - t4)) / 2;
+    sample.localTime = t1 + (t4 - t1) / 2;
+
+    _samples[_sampleIdx] = sample;
+    _sampleIdx = (_sampleIdx + 1) % CLOCK_SYNC_WINDOW;
+    if (_sampleCount < CLOCK_SYNC_WINDOW) {
+        _sampleCount++;
+    }
+    estimate();
+}
+
+void ClockSync::estimate() {
+    int64_t minRoundTrip = INT64_MAX;
+    int64_t refTime = _samples[(_sampleIdx + CLOCK_SYNC_WINDOW - 1) % CLOCK_SYNC_WINDOW].localTime;
+    for (int i = 0; i < _sampleCount; i++) {
+        minRoundTrip = min(minRoundTrip, _samples[i].roundTrip);
+    }
+
+    // least squares fit of offset(localTime) over the samples close to the best round trip
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    int count = 0;
+    int64_t refOffset = 0;
+    for (int i = 0; i < _sampleCount; i++) {
+        if (_samples[i].roundTrip > minRoundTrip + CLOCK_SYNC_RTT_MARGIN) {
+            continue;
+        }
+        if (count == 0) {
+            refOffset = _samples[i].offset;  // keeps the doubles small
+        }
+        double x = _samples[i].localTime - refTime;
+        double y = _samples[i].offset - refOffset;
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+        count++;
+    }
+
+    double drift = 0;
+    double denominator = count * sumXX - sumX * sumX;
+    if (count > 1 && denominator > 0) {
+        drift = (count * sumXY - sumX * sumY) / denominator;
+        drift = constrain(drift, -CLOCK_SYNC_MAX_DRIFT, CLOCK_SYNC_MAX_DRIFT);
+    }
+    int64_t offset = refOffset + (int64_t)((sumY - drift * sumX) / count);
+
+    portENTER_CRITICAL(&_lock);
+    _refTime = refTime;
+    _offset = offset;
+    _drift = drift;
+    _roundTrip = minRoundTrip;
+    _synchronized = _sampleCount >= CLOCK_SYNC_MIN_SAMPLES;
+    portEXIT_CRITICAL(&_lock);
+}
+
+bool ClockSync::isSynchronized() {
+    return _synchronized;
+}
+
+int64_t ClockSync::toPeerTime(int64_t localTime) {
+    portENTER_CRITICAL(&_lock);
+    int64_t peerTime = localTime + _offset + (int64_t)(_drift * (localTime - _refTime));
+    portEXIT_CRITICAL(&_lock);
+    return peerTime;
+}
+
+int64_t ClockSync::toLocalTime(int64_t peerTime) {
+    portENTER_CRITICAL(&_lock);
+    // drift is tiny, evaluating it at the peer time instead of the local one is good enough
+    int64_t localTime = peerTime - _offset - (int64_t)(_drift * (peerTime - _offset - _refTime));
+    portEXIT_CRITICAL(&_lock);
+    return localTime;
+}
+
+int64_t ClockSync::getRoundTrip() {
+    return _roundTrip;
+}
@@ -0,0 +1,64 @@
+#ifndef clocksync_h
+#define clocksync_h
+
+#include <Arduino.h>
+
+#define CLOCK_SYNC_PERIOD 250          // [ms] ping period
+#define CLOCK_SYNC_WINDOW 16           // number of ping/pong samples the estimate is based on
+#define CLOCK_SYNC_MIN_SAMPLES 4       // samples needed before the clock is considered synchronized
+#define CLOCK_SYNC_RTT_MARGIN 300      // [us] accepted round trip above the best one in the window
+#define CLOCK_SYNC_MAX_DRIFT 0.0005    // crystals are within tens of ppm, anything above is noise
+
+typedef struct ClockSyncSample {
+    int64_t localTime;  // midpoint of the exchange in the local clock
+    int64_t offset;     // peer time - local time
+    int64_t roundTrip;
+} ClockSyncSample;
+
+/**
+ * NTP-like estimator of the peer (start device) clock.
+ *
+ * Every ping/pong exchange gives four timestamps: ping sent (t1, local), ping received (t2, peer),
+ * pong sent (t3, peer), pong received (t4, local). Offset and drift are fitted by linear regression
+ * over the recent samples with the smallest round trip, i.e. the least delayed by the radio and queues.
+ */
+class ClockSync {
+   public:
+    ClockSync();
+
+    /**
+     * @brief Add a completed ping/pong exchange.
+     */
+    void addSample(int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+    bool isSynchronized();
+
+    /**
+     * @brief Converts the local timestamp to the peer clock domain.
+     */
+    int64_t toPeerTime(int64_t localTime);
+
+    /**
+     * @brief Converts the peer timestamp to the local clock domain.
+     */
+    int64_t toLocalTime(int64_t peerTime);
+
+    int64_t getRoundTrip();
+
+   private:
+    ClockSyncSample _samples[CLOCK_SYNC_WINDOW];
+    uint8_t _sampleIdx;
+    uint8_t _sampleCount;
+
+    // peer time = local time + _offset + _drift * (local time - _refTime)
+    int64_t _refTime;
+    int64_t _offset;
+    double _drift;
+    int64_t _roundTrip;
+    bool _synchronized;
+    portMUX_TYPE _lock;
+
+    void estimate();
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "console.h"
+
+ConsoleOutput Console;
+
+ConsoleOutput::ConsoleOutput() {
+    _output = NULL;
+    _mutex = NULL;
+    _held = false;
+    _dropped = 0;
+}
+
+void ConsoleOutput::begin(Print *output) {
+    _output = output;
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+}
+
+void ConsoleOutput::hold() {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _held = true;
+    xSemaphoreGive(_mutex);
+}
+
+void ConsoleOutput::release() {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _held = false;
+    uint32_t dropped = _dropped;
+    _dropped = 0;
+    xSemaphoreGive(_mutex);
+    if (dropped > 0) {
+        printf("%u B of text dropped while the port was held\r\n", (unsigned)dropped);
+    }
+}
+
+size_t ConsoleOutput::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t ConsoleOutput::write(const uint8_t *buffer, size_t size) {
+    if (_mutex == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_held) {
+        _dropped += size;
+    } else {
+        _output->write(buffer, size);
+    }
+    xSemaphoreGive(_mutex);
+    return size;
+}
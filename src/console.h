@@ -0,0 +1,34 @@
+#ifndef console_h
+#define console_h
+
+#include <Arduino.h>
+
+/**
+ * Text output of the logs and the serial commands on the serial port. The exporter holds it while
+ * its binary frames go out on the same port, text written meanwhile is dropped and counted.
+ */
+class ConsoleOutput : public Print {
+   public:
+    ConsoleOutput();
+    void begin(Print *output);
+
+    /**
+     * @brief Waits for the write in progress, from then on the text is dropped until release().
+     */
+    void hold();
+    void release();
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+
+   private:
+    Print *_output;
+    SemaphoreHandle_t _mutex;
+    StaticSemaphore_t _mutexBuffer;
+    bool _held;
+    uint32_t _dropped;  // [B]
+};
+
+extern ConsoleOutput Console;
+
+#endif
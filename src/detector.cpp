@@ -1,15 +1,77 @@
 #include "detector.h"
 
+#if DETECTOR_ISR_CAPTURE
+#include <soc/gpio_struct.h>
+#endif
+
 #include "logging.h"
+#include "timebase.h"
 
 Detector::Detector() {
     _detectorPulseInTimeout = 2 * (unsigned long)((float)RANGE_THRESHOLD_CM / (float)SOUND_SPEED_HALF);
+    _config.windowSize = DETECTOR_WINDOW_SIZE;
+    _config.arriveThreshold = RANGE_THRESHOLD_CM;
+    _config.leaveThreshold = DETECTOR_LEAVE_THRESHOLD_CM;
+    _config.relativeTolerance = DISTANCE_RELATIVE_TOLERANCE;
+    _config.medianFilter = DETECTOR_MEDIAN_FILTER;
+    _config.maxTimeouts = DETECTOR_MAX_TIMEOUTS;
+    _config.learnBackground = DETECTOR_LEARN_BACKGROUND;
+    _configChanged = false;
+    _learning = false;
+    _backgroundReset = false;
+    static const uint8_t triggerPins[DETECTOR_SENSORS_MAX] = DETECTOR_TRIGGER_PINS;
+    static const uint8_t echoPins[DETECTOR_SENSORS_MAX] = DETECTOR_ECHO_PINS;
+    for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+        _sensors[i].detector = this;
+        _sensors[i].index = i;
+        _sensors[i].triggerPin = triggerPins[i];
+        _sensors[i].echoPin = echoPins[i];
+    }
+    _sensor = &_sensors[0];
+    _roundSize = 0;
+    _triggered = &_sensors[0];
+    _echoPending = false;
+    _echoEndTime = 0;
+    resetWindows();
+}
+
+void Detector::resetWindows() {
+    for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+        _sensors[i].windowIdx = _sensors[i].windowCount = 0;
+    }
 }
 
 void Detector::startMeasurement() {
     _prevObjectDetected = false;
+    for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+        _sensors[i].objectDetected = false;
+    }
+    resetWindows();
     _measurementEnabled = true;
-    _prevPrevDistance = _prevDistance = _distance = 0;
+}
+
+void Detector::setConfig(DetectorConfig config) {
+    config.windowSize = constrain(config.windowSize, 1, DETECTOR_WINDOW_MAX);
+    config.leaveThreshold = max(config.leaveThreshold, config.arriveThreshold);
+    _pendingConfig = config;
+    _configChanged = true;
+}
+
+DetectorConfig Detector::getConfig() {
+    return _configChanged ? _pendingConfig : _config;
+}
+
+void Detector::setLearning(bool learning) {
+    _learning = learning;
+}
+
+// takes effect with the next round, the models belong to the sampling task
+void Detector::resetBackground() {
+    _backgroundReset = true;
+}
+
+BackgroundModel Detector::getBackground(uint8_t sensor) {
+    return _sensors[sensor].background;
 }
 
 void Detector::stopMeasurement() {
@@ -17,54 +79,371 @@ void Detector::stopMeasurement() {
 }
 
 void Detector::init() {
-    pinMode(TRIGGER_PIN, OUTPUT);
-    pinMode(ECHO_PIN, INPUT_PULLDOWN);
+#if DETECTOR_ISR_CAPTURE
+    _echoRiseTime = 0;
+    _activeSensor = 0;
+    _echoQueue = xQueueCreateStatic(ECHO_QUEUE_LENGTH, sizeof(EchoSample), _echoQueueStorage, &_echoQueueBuffer);
+#endif
+    for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+        pinMode(_sensors[i].triggerPin, OUTPUT);
+        pinMode(_sensors[i].echoPin, INPUT_PULLDOWN);
+#if DETECTOR_ISR_CAPTURE
+        attachInterruptArg(digitalPinToInterrupt(_sensors[i].echoPin), echoIsr, &_sensors[i], CHANGE);
+#endif
+    }
+}
+
+#if DETECTOR_ISR_CAPTURE
+/**
+ * Echo edge ISR, runs from IRAM. The rising edge is remembered, the falling edge completes
+ * the sample and hands it over to the sampling task. A falling edge without a preceding
+ * rising edge (echo started before the trigger) is dropped, so are the edges of the sensors
+ * not triggered right now.
+ */
+void IRAM_ATTR Detector::echoIsr(void *arg) {
+    DetectorSensor *sensor = (DetectorSensor *)arg;
+    Detector *detector = sensor->detector;
+    int64_t now = nowMicros();
+    if (sensor->index != detector->_activeSensor) {
+        return;
+    }
+    if ((GPIO.in >> sensor->echoPin) & 0x1) {
+        detector->_echoRiseTime = now;
+    } else if (detector->_echoRiseTime != 0) {
+        EchoSample sample;
+        sample.riseTime = detector->_echoRiseTime;
+        sample.fallTime = now;
+        detector->_echoRiseTime = 0;
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        xQueueSendFromISR(detector->_echoQueue, &sample, &higherPriorityTaskWoken);
+        if (higherPriorityTaskWoken == pdTRUE) {
+            portYIELD_FROM_ISR();
+        }
+    }
 }
+#endif
 
-uint32_t Detector::getCompensationTime() {
-    return _time - _prevPrevTime;
+int64_t Detector::getCompensationTime() {
+    return _compensationTime;
 }
 
-float Detector::measureDistance() {
-    digitalWrite(TRIGGER_PIN, LOW);
+int64_t Detector::getCrossingTime() {
+    return _crossingTime;
+}
+
+int64_t Detector::getTriggerTime() {
+    return _triggerTime;
+}
+
+int64_t Detector::getSampleTime() {
+    return _sampleTime;
+}
+
+uint16_t Detector::getEchoDuration() {
+    return _echoDuration;
+}
+
+uint8_t Detector::getRoundSize() {
+    return _roundSize;
+}
+
+const DetectorSample &Detector::getRoundSample(uint8_t idx) {
+    return _round[idx];
+}
+
+bool Detector::isMeasurementEnabled() {
+    return _measurementEnabled;
+}
+
+bool Detector::isObjectDetected() {
+    return _prevObjectDetected;
+}
+
+float Detector::measureDistance(DetectorSensor &sensor) {
+#if DETECTOR_ISR_CAPTURE
+    // forget edges belonging to an earlier trigger
+    xQueueReset(_echoQueue);
+    _echoRiseTime = 0;
+    _activeSensor = sensor.index;
+#endif
+    _echoDuration = 0;
+    _triggered = &sensor;
+    _echoPending = true;
+    digitalWrite(sensor.triggerPin, LOW);
     delayMicroseconds(5);
-    digitalWrite(TRIGGER_PIN, HIGH);
+    digitalWrite(sensor.triggerPin, HIGH);
     delayMicroseconds(1);
-    digitalWrite(TRIGGER_PIN, LOW);
+    digitalWrite(sensor.triggerPin, LOW);
+    _triggerTime = nowMicros();
+#if DETECTOR_ISR_CAPTURE
+    // the task sleeps (no spinning) until the ISR delivers the falling edge
+    EchoSample sample;
+    _sampleTime = nowMicros();
+    if (xQueueReceive(_echoQueue, &sample, _detectorPulseInTimeout / 1000 / portTICK_PERIOD_MS + 2) != pdTRUE) {
+        _echoPending = _echoRiseTime != 0;  // no rising edge, nothing in flight
+        return DISTANCE_TIMEOUT;
+    }
+    _echoPending = false;
+    _echoEndTime = sample.fallTime;
+    _sampleTime = sample.riseTime;
+    long duration = (long)(sample.fallTime - sample.riseTime);
+    if (duration > (long)_detectorPulseInTimeout) {  // out of range, same as pulseIn timeout
+        return DISTANCE_TIMEOUT;
+    }
+#else
     // Serial.print(millis());
     // Serial.print("ms ");
-    long duration = pulseIn(ECHO_PIN, HIGH, _detectorPulseInTimeout);
+    _sampleTime = nowMicros();
+    long duration = pulseIn(sensor.echoPin, HIGH, _detectorPulseInTimeout);
     // Serial.print(millis());
     // Serial.print("ms ~ ");
     // Serial.println(duration);
     if (duration == 0) {  // pulseIn timeout
-        return 10 * RANGE_THRESHOLD_CM;
+        return DISTANCE_TIMEOUT;
     }
+    _echoPending = false;
+    _echoEndTime = nowMicros();
+#endif
+    _echoDuration = duration;
     return duration * SOUND_SPEED_HALF;
 }
 
+DetectorSample &Detector::windowSample(uint8_t idx) {
+    return _sensor->window[(_sensor->windowIdx + idx) % _config.windowSize];
+}
+
+// median of the window, timeouts count as infinitely far
+float Detector::windowMedian() {
+    float sorted[DETECTOR_WINDOW_MAX];
+    for (uint8_t i = 0; i < _config.windowSize; i++) {
+        float distance = windowSample(i).distance;
+        if (distance == DISTANCE_TIMEOUT) {
+            distance = INFINITY;
+        }
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > distance; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = distance;
+    }
+    return sorted[_config.windowSize / 2];
+}
+
+float Detector::getArriveThreshold(uint8_t sensor) {
+    return arriveThreshold(_sensors[sensor]);
+}
+
+float Detector::arriveThreshold() {
+    return arriveThreshold(*_sensor);
+}
+
+/**
+ * Learned threshold when the background of the sensor has a surface, the configured one otherwise.
+ */
+float Detector::arriveThreshold(DetectorSensor &sensor) {
+    BackgroundModel &background = sensor.background;
+    if (_config.learnBackground && background.isReady() && background.hasSurface()) {
+        return background.getArriveThreshold();
+    }
+    return _config.arriveThreshold;
+}
+
+// configured hysteresis, up to half way to the learned background so the object can leave
+float Detector::leaveThreshold() {
+    float arrive = arriveThreshold();
+    float hysteresis = _config.leaveThreshold - _config.arriveThreshold;
+    if (arrive != _config.arriveThreshold) {
+        hysteresis = min(hysteresis, (_sensor->background.getMean() - arrive) / 2);
+    }
+    return arrive + hysteresis;
+}
+
+/**
+ * Object arrived when the window is close (all samples, or the median) and the close samples agree
+ * within the tolerance. Up to maxTimeouts missing echoes are rejected as outliers.
+ */
+bool Detector::isArrived() {
+    float threshold = arriveThreshold();
+    uint8_t timeouts = 0;
+    float minDistance = INFINITY;
+    float maxDistance = 0;
+    for (uint8_t i = 0; i < _config.windowSize; i++) {
+        float distance = windowSample(i).distance;
+        if (distance == DISTANCE_TIMEOUT) {
+            timeouts++;
+            continue;
+        }
+        if (distance > threshold && !_config.medianFilter) {
+            return false;
+        }
+        if (distance <= threshold) {
+            minDistance = min(minDistance, distance);
+            maxDistance = max(maxDistance, distance);
+        }
+    }
+    if (timeouts > _config.maxTimeouts || maxDistance <= 0) {
+        return false;
+    }
+    if (_config.medianFilter && windowMedian() > threshold) {
+        return false;
+    }
+    return (maxDistance - minDistance) / maxDistance < _config.relativeTolerance;
+}
+
+/**
+ * Object left when the window is far (all samples, or the median), timeouts are far as well.
+ */
+bool Detector::isLeft() {
+    float threshold = leaveThreshold();
+    if (_config.medianFilter) {
+        return windowMedian() > threshold;
+    }
+    for (uint8_t i = 0; i < _config.windowSize; i++) {
+        float distance = windowSample(i).distance;
+        if (distance != DISTANCE_TIMEOUT && distance <= threshold) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The crossing happened with the earliest sample of the confirming window on the new side of the
+ * threshold - the older ones (median, tolerated timeouts) can still be from before the crossing.
+ */
+int64_t Detector::crossingTime(bool arrived) {
+    for (uint8_t i = 0; i < _config.windowSize; i++) {
+        float distance = windowSample(i).distance;
+        bool close = distance != DISTANCE_TIMEOUT && distance <= (arrived ? arriveThreshold() : leaveThreshold());
+        if (close == arrived) {
+            return windowSample(i).time;
+        }
+    }
+    return windowSample(_config.windowSize - 1).time;
+}
+
+// a tick delay ends on a tick boundary, the extra tick covers the partial one
+static TickType_t ticksAtLeast(int64_t us) {
+    return (us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000) + 1;
+}
+
+// a timed out echo keeps the pin high while the burst is still in flight, a late reflection of it
+// would reach the next sensor - the task sleeps until the echo ended and the reverberation decayed
+void Detector::waitEchoEnd() {
+    if (_echoPending) {
+        int64_t deadline = _triggerTime + DETECTOR_ECHO_MAX;
+#if DETECTOR_ISR_CAPTURE
+        EchoSample sample;
+        int64_t remaining = deadline - nowMicros();
+        if (remaining > 0 && xQueueReceive(_echoQueue, &sample, ticksAtLeast(remaining)) == pdTRUE) {
+            _echoEndTime = sample.fallTime;
+        } else {
+            _echoEndTime = nowMicros();
+        }
+#else
+        while (digitalRead(_triggered->echoPin) == HIGH && nowMicros() < deadline) {
+            vTaskDelay(1);
+        }
+        _echoEndTime = nowMicros();
+#endif
+        _echoPending = false;
+    }
+    int64_t guard = _echoEndTime + DETECTOR_SENSOR_GUARD - nowMicros();
+    if (guard > 0) {
+        vTaskDelay(ticksAtLeast(guard));
+    }
+}
+
+/**
+ * Triggers the sensors one after another. With evaluate set, every sample goes to the window of its
+ * sensor and the sensor decisions are updated. arrivedTime is the earliest crossing of the sensors
+ * confirming the object in this round (INT64_MAX when none), leftTime the latest crossing of the
+ * sensors losing it (0 when none).
+ */
+void Detector::sampleRound(bool evaluate, int64_t &arrivedTime, int64_t &leftTime) {
+    arrivedTime = INT64_MAX;
+    leftTime = 0;
+    _roundSize = 0;
+    for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+        waitEchoEnd();
+        _sensor = &_sensors[i];
+        DetectorSample sample;
+        sample.distance = measureDistance(*_sensor);
+        sample.time = _sampleTime;
+        sample.echoDuration = _echoDuration;
+        sample.sensor = i;
+        _round[_roundSize++] = sample;
+        if (!evaluate) {
+            continue;
+        }
+
+        // the ring buffer is full, overwrite the oldest sample
+        if (_sensor->windowCount == _config.windowSize) {
+            _sensor->window[_sensor->windowIdx] = sample;
+            _sensor->windowIdx = (_sensor->windowIdx + 1) % _config.windowSize;
+        } else {
+            _sensor->window[(_sensor->windowIdx + _sensor->windowCount) % _config.windowSize] = sample;
+            _sensor->windowCount++;
+        }
+        if (_sensor->windowCount < _config.windowSize) {
+            continue;
+        }
+
+        if (_sensor->objectDetected && isLeft()) {
+            _sensor->objectDetected = false;
+            leftTime = max(leftTime, crossingTime(false));
+        } else if (!_sensor->objectDetected && isArrived()) {
+            _sensor->objectDetected = true;
+            arrivedTime = min(arrivedTime, crossingTime(true));
+        }
+        if (_learning && !_sensor->objectDetected && _sensor->background.isConsistent(sample.distance)) {
+            _sensor->background.add(sample.distance);
+        }
+    }
+}
+
+void Detector::probe() {
+    int64_t arrivedTime, leftTime;
+    sampleRound(false, arrivedTime, leftTime);
+}
+
 DetectedObjectState Detector::read() {
     if (_measurementEnabled) {
-        _prevPrevDistance = _prevDistance;
-        _prevDistance = _distance;
-        _distance = measureDistance();
+        if (_configChanged) {
+            _config = _pendingConfig;
+            _configChanged = false;
+            resetWindows();
+        }
+        if (_backgroundReset) {
+            _backgroundReset = false;
+            for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+                _sensors[i].background.reset();
+            }
+        }
 
-        _prevPrevTime = _prevTime;
-        _prevTime = _time;
-        _time = millis();
+        int64_t arrivedTime, leftTime;
+        sampleRound(true, arrivedTime, leftTime);
+        bool objectDetected = false;
+        for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+            objectDetected |= _sensors[i].objectDetected;
+        }
 
-        if (_distance > 0 && _prevDistance > 0 && _prevPrevDistance > 0 &&
-            _distance > RANGE_THRESHOLD_CM && _prevDistance > RANGE_THRESHOLD_CM && _prevPrevDistance > RANGE_THRESHOLD_CM && _prevObjectDetected) {
+        DetectedObjectState state = NONE;
+        if (_prevObjectDetected && !objectDetected) {
             _prevObjectDetected = false;
-            Log.infoln("LEFT %F cm (%Fcm, %Fcm)", _distance, _prevDistance, _prevPrevDistance);
-            return LEFT;
-        } else if (_distance > 0 && _prevDistance > 0 && _prevPrevDistance > 0 &&
-                   _distance <= RANGE_THRESHOLD_CM && _prevDistance <= RANGE_THRESHOLD_CM && _prevPrevDistance <= RANGE_THRESHOLD_CM &&
-                   abs(1 - _distance / _prevDistance) < DISTANCE_RELATIVE_TOLERANCE && abs(1 - _prevPrevDistance / _prevPrevDistance) < DISTANCE_RELATIVE_TOLERANCE && !_prevObjectDetected) {
+            state = LEFT;
+            _crossingTime = leftTime;
+        } else if (!_prevObjectDetected && objectDetected) {
             _prevObjectDetected = true;
-            Log.infoln("ARRIVED %F cm (%Fcm, %Fcm)", _distance, _prevDistance, _prevPrevDistance);
-            return ARRIVED;
+            state = ARRIVED;
+            _crossingTime = arrivedTime;
+        }
+        if (state != NONE) {
+            _compensationTime = _sampleTime - _crossingTime;
+            DLog.infoln("%s %F cm (sensors %d, window %d)", state == ARRIVED ? "ARRIVED" : "LEFT", _round[_roundSize - 1].distance, DETECTOR_SENSORS,
+                        _config.windowSize);
         }
+        return state;
     }
     return NONE;
 }
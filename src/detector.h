@@ -3,11 +3,54 @@
 
 #include <Arduino.h>
 
-#define TRIGGER_PIN 26
+#include "background.h"
+
+#define TRIGGER_PIN 26  // first sensor
 #define ECHO_PIN 25
 #define RANGE_THRESHOLD_CM 70
 #define SOUND_SPEED_HALF 0.017
 #define DISTANCE_RELATIVE_TOLERANCE 0.2
+#define DISTANCE_TIMEOUT -1  // no echo within the range
+
+// default detection stage configuration, see DetectorConfig
+#define DETECTOR_WINDOW_MAX 16
+#ifndef DETECTOR_WINDOW_SIZE
+#define DETECTOR_WINDOW_SIZE 3
+#endif
+#ifndef DETECTOR_LEAVE_THRESHOLD_CM
+#define DETECTOR_LEAVE_THRESHOLD_CM RANGE_THRESHOLD_CM
+#endif
+#ifndef DETECTOR_MEDIAN_FILTER
+#define DETECTOR_MEDIAN_FILTER false
+#endif
+#ifndef DETECTOR_MAX_TIMEOUTS
+#define DETECTOR_MAX_TIMEOUTS 0
+#endif
+#ifndef DETECTOR_LEARN_BACKGROUND
+#define DETECTOR_LEARN_BACKGROUND true
+#endif
+
+// sensors of the gate, 1 to DETECTOR_SENSORS_MAX, triggered one after another within a round
+#define DETECTOR_SENSORS_MAX 4
+#ifndef DETECTOR_SENSORS
+#define DETECTOR_SENSORS 1
+#endif
+#ifndef DETECTOR_TRIGGER_PINS
+#define DETECTOR_TRIGGER_PINS {TRIGGER_PIN, 27, 4, 16}
+#endif
+#ifndef DETECTOR_ECHO_PINS
+#define DETECTOR_ECHO_PINS {ECHO_PIN, 17, 18, 19}  // below 32, the ISR reads GPIO.in
+#endif
+#ifndef DETECTOR_SENSOR_GUARD
+#define DETECTOR_SENSOR_GUARD 2000  // [us] between the end of an echo and the next trigger, reverberation decays
+#endif
+#define DETECTOR_ECHO_MAX 38000     // [us] the HC-SR04 holds the echo pin up to that long after the trigger
+
+// echo capture mode - timestamp echo edges in a GPIO ISR (1) or block in pulseIn (0)
+#ifndef DETECTOR_ISR_CAPTURE
+#define DETECTOR_ISR_CAPTURE 1
+#endif
+#define ECHO_QUEUE_LENGTH 4
 
 typedef enum {
     NONE,
@@ -15,30 +58,171 @@ typedef enum {
     LEFT
 } DetectedObjectState;
 
+/**
+ * Detection stage configuration, defaults come from the DETECTOR_* macros.
+ */
+typedef struct DetectorConfig {
+    uint8_t windowSize;       // samples needed to confirm ARRIVED/LEFT, up to DETECTOR_WINDOW_MAX
+    float arriveThreshold;    // [cm] object is present when closer
+    float leaveThreshold;     // [cm] object is gone when farther, hysteresis when above arriveThreshold
+    float relativeTolerance;  // max relative spread of the distances confirming ARRIVED
+    bool medianFilter;        // decide on the median of the window instead of requiring all samples
+    uint8_t maxTimeouts;      // echo timeouts ignored as outliers while confirming ARRIVED
+    bool learnBackground;     // thresholds from the learned background when it has a surface, see BackgroundModel
+} DetectorConfig;
+
+typedef struct DetectorSample {
+    float distance;         // [cm] or DISTANCE_TIMEOUT
+    int64_t time;           // [us]
+    uint16_t echoDuration;  // [us], 0 on timeout
+    uint8_t sensor;
+} DetectorSample;
+
+class Detector;
+
+/**
+ * Ultrasonic sensor of the gate with its own window of samples, see DetectorConfig.windowSize.
+ */
+typedef struct DetectorSensor {
+    Detector *detector;  // for the echo ISR
+    uint8_t index;
+    uint8_t triggerPin;
+    uint8_t echoPin;
+    bool objectDetected;  // object in the cone of this sensor
+    BackgroundModel background;
+    // ring buffer of the latest samples, windowIdx points to the oldest one
+    DetectorSample window[DETECTOR_WINDOW_MAX];
+    uint8_t windowIdx;
+    uint8_t windowCount;
+} DetectorSensor;
+
+/**
+ * Single echo captured by the edge ISR, both edges in esp_timer microseconds.
+ */
+typedef struct EchoSample {
+    int64_t riseTime;
+    int64_t fallTime;
+} EchoSample;
+
+/**
+ * Gate of DETECTOR_SENSORS ultrasonic sensors.
+ *
+ * Every read() is one round: the sensors are triggered one after another, each trigger (the first one
+ * of a round included) only DETECTOR_SENSOR_GUARD after the echo of the previous trigger ended, so a
+ * sensor never hears the burst of another one while the round stays as short as the echoes allow.
+ * After a capture timeout the burst can still be in flight, the echo pin stays high until the sensor
+ * gives up (DETECTOR_ECHO_MAX); the task sleeps until the falling edge meanwhile. Each sensor confirms
+ * the object in its own window, the decisions are fused - ARRIVED when the first sensor confirms the
+ * object (the earliest crossing among the sensors confirming in the round), LEFT when the last one
+ * loses it.
+ */
 class Detector {
    public:
     Detector();
     void init();
     DetectedObjectState read();
+
+    /**
+     * @brief Takes a single sample outside of the detection, the window is left untouched (jitter benchmark).
+     */
+    void probe();
     void startMeasurement();
     void stopMeasurement();
-    uint32_t getCompensationTime();
+    int64_t getCompensationTime();
+
+    /**
+     * @brief Timestamp of the crossing reported by the last ARRIVED/LEFT (microseconds).
+     */
+    int64_t getCrossingTime();
+
+    /**
+     * @brief Trigger pulse of the latest sample (microseconds).
+     */
+    int64_t getTriggerTime();
+
+    /**
+     * @brief Rising echo edge of the latest sample (microseconds, see timebase.h).
+     */
+    int64_t getSampleTime();
+
+    /**
+     * @brief Echo duration of the latest sample (microseconds), 0 on timeout.
+     */
+    uint16_t getEchoDuration();
+
+    /**
+     * @brief Samples taken by the last read() or probe(), one per sensor.
+     */
+    uint8_t getRoundSize();
+    const DetectorSample &getRoundSample(uint8_t idx);
+
+    bool isMeasurementEnabled();
+    bool isObjectDetected();
+
+    /**
+     * @brief Changes the detection stage, takes effect with the next sample.
+     */
+    void setConfig(DetectorConfig config);
+    DetectorConfig getConfig();
+
+    /**
+     * @brief Enables learning of the background, the samples of a sensor not seeing an object are learned.
+     */
+    void setLearning(bool learning);
+    void resetBackground();
+    BackgroundModel getBackground(uint8_t sensor);
+
+    /**
+     * @brief [cm] arrive threshold in effect for the sensor, the learned one when the background has a surface.
+     */
+    float getArriveThreshold(uint8_t sensor);
 
    private:
     bool _prevObjectDetected;
     bool _measurementEnabled = false;
-    float measureDistance();
+    float measureDistance(DetectorSensor &sensor);
     unsigned long _detectorPulseInTimeout;
 
-    float _distance;
-    float _prevDistance;
-    float _prevPrevDistance;
-    
-    uint32_t _time;
-    uint32_t _prevTime;    
-    uint32_t _prevPrevTime;
-    
+    DetectorConfig _config;
+    DetectorConfig _pendingConfig;
+    volatile bool _configChanged;
+    volatile bool _learning;
+    volatile bool _backgroundReset;
 
+    DetectorSensor _sensors[DETECTOR_SENSORS];
+    DetectorSensor *_sensor;  // the one being evaluated by windowSample(), isArrived() and isLeft()
+    DetectorSample _round[DETECTOR_SENSORS];
+    uint8_t _roundSize;
+
+    int64_t _triggerTime;
+    DetectorSensor *_triggered;  // sensor of the latest trigger
+    bool _echoPending;           // its echo timed out, the pin can still be high
+    int64_t _echoEndTime;        // [us] its echo ended
+    int64_t _sampleTime;
+    uint16_t _echoDuration;
+    int64_t _crossingTime;
+    int64_t _compensationTime;
+
+    void resetWindows();
+    void waitEchoEnd();
+    void sampleRound(bool evaluate, int64_t &arrivedTime, int64_t &leftTime);
+    DetectorSample &windowSample(uint8_t idx);
+    float windowMedian();
+    float arriveThreshold();
+    float arriveThreshold(DetectorSensor &sensor);
+    float leaveThreshold();
+    bool isArrived();
+    bool isLeft();
+    int64_t crossingTime(bool arrived);
+
+#if DETECTOR_ISR_CAPTURE
+    QueueHandle_t _echoQueue;
+    StaticQueue_t _echoQueueBuffer;
+    uint8_t _echoQueueStorage[ECHO_QUEUE_LENGTH * sizeof(EchoSample)];
+    volatile int64_t _echoRiseTime;
+    volatile uint8_t _activeSensor;  // edges of the other sensors are ignored
+    static void echoIsr(void *arg);
+#endif
 };
 
 #endif
@@ -1,5 +1,10 @@
 #include "display.h"
 
+#include <new>
+
+#include "scheduler.h"
+#include "timebase.h"
+
 #define CLK 14
 #define DIO 13
 
@@ -157,42 +162,97 @@ const uint8_t ERROR[6][4] = {
 };
 
 Display::Display() {
+    _shadowValid = false;
+    _changeCallback = NULL;
 }
 
 void Display::init() {
-    _tm1637 = new TM1637Display(CLK, DIO);
+    _tm1637 = new (_tm1637Storage) TM1637Display(CLK, DIO);
     _tm1637->setBrightness(0x0f);
 }
 
+void Display::setChangeCallback(void (*callback)()) {
+    _changeCallback = callback;
+}
+
+void Display::changed() {
+    if (_changeCallback != NULL) {
+        _changeCallback();
+    }
+}
+
 void Display::showNumber(uint16_t number) {
     _mode = NUMBER;
     _number = number;
+    changed();
 }
 
 void Display::showZeroTime() {
     _mode = ZERO_TIME;
+    changed();
 }
 
-void Display::showTimeContinuously(uint32_t time) {
+void Display::showTimeContinuously(int64_t time) {
     _mode = CONTINUOUS_TIME;
-    _startTime = millis() - time;
+    _startTime = nowMicros() - time;
+    changed();
 }
 
-void Display::showTime(uint32_t time) {
+void Display::showTime(int64_t time) {
     _mode = TIME;
     _time = time;
+    changed();
+}
+
+/**
+ * Encodes the number as 4 digits, dots mask as in TM1637Display::showNumberDecEx.
+ */
+void Display::encodeNumber(uint16_t number, uint8_t dots, bool leadingZero, uint8_t segments[4]) {
+    for (int8_t i = 3; i >= 0; i--) {
+        uint8_t digit = number % 10;
+        segments[i] = (number == 0 && i < 3 && !leadingZero) ? 0 : digitToSegment[digit];
+        number /= 10;
+    }
+    for (uint8_t i = 0; i < 4; i++) {
+        segments[i] |= dots & 0x80;
+        dots <<= 1;
+    }
 }
 
-void Display::showTimeInternal(uint32_t time) {
-    int divider = 1;
+// returns the delay [us] until the shown value changes
+int64_t Display::encodeTime(int64_t time, uint8_t segments[4]) {
+    // the only place where the microsecond time gets truncated
+    uint32_t ms = (uint32_t)(time / MICROS_PER_MILLI);
     // less than 99.99s
-    if (time <= 59999) {
-        _tm1637->showNumberDecEx(time / 10, 0b01000000, true);
+    if (ms <= 59999) {
+        encodeNumber(ms / 10, 0b01000000, true, segments);
+        return 10 * MICROS_PER_MILLI - time % (10 * MICROS_PER_MILLI);
     } else {
-        uint32_t mins = time / 1000 / 60;
-        uint32_t secs = time / 1000 - mins * 60;
-        _tm1637->showNumberDecEx(mins * 100 + secs, 0b01000000, true);
+        uint32_t mins = ms / 1000 / 60;
+        uint32_t secs = ms / 1000 - mins * 60;
+        encodeNumber(mins * 100 + secs, 0b01000000, true, segments);
+        return 1000 * MICROS_PER_MILLI - time % (1000 * MICROS_PER_MILLI);
+    }
+}
+
+/**
+ * Sends only the digits differing from the shadow copy, each run of changed digits in one transfer.
+ */
+void Display::render(const uint8_t segments[4]) {
+    uint8_t i = 0;
+    while (i < 4) {
+        if (_shadowValid && segments[i] == _shadow[i]) {
+            i++;
+            continue;
+        }
+        uint8_t first = i;
+        while (i < 4 && (!_shadowValid || segments[i] != _shadow[i])) {
+            _shadow[i] = segments[i];
+            i++;
+        }
+        _tm1637->setSegments(_shadow + first, i - first, first);
     }
+    _shadowValid = true;
 }
 
 void Display::showConnecting() {
@@ -202,6 +262,7 @@ void Display::showConnecting() {
     _frameIdx = 0;
     _frameDelay = 350;
     _nextFrameMillis = millis() + _frameDelay;
+    changed();
 }
 
 void Display::showError() {
@@ -211,29 +272,36 @@ void Display::showError() {
     _frameIdx = 0;
     _frameDelay = 350;
     _nextFrameMillis = millis() + _frameDelay;
+    changed();
 }
 
-void Display::update() {
+int64_t Display::update() {
+    uint8_t segments[4];
+    int64_t nextUpdate = SCHEDULER_IDLE;
     switch (_mode) {
         case ZERO_TIME:
-            _tm1637->showNumberDecEx(0, 0b1000000, true);
+            encodeNumber(0, 0b1000000, true, segments);
             break;
         case NUMBER:
-            _tm1637->showNumberDec(_number);
+            encodeNumber(_number, 0, false, segments);
             break;
         case CONTINUOUS_TIME:
-            showTimeInternal(millis() - _startTime);            
+            nextUpdate = encodeTime(nowMicros() - _startTime, segments);
             break;
         case TIME:
-            showTimeInternal(_time);
+            encodeTime(_time, segments);
             break;
         case ANIMATION:
-            _tm1637->setSegments(_frames[_frameIdx]);
+            memcpy(segments, _frames[_frameIdx], 4);
             if (millis() >= _nextFrameMillis) {
                 _nextFrameMillis = _nextFrameMillis + _frameDelay;
                 _frameIdx = (_frameIdx + 1) % _framesCount;
             }
-        default:
+            nextUpdate = max((int64_t)_nextFrameMillis - (int64_t)millis(), (int64_t)0) * MICROS_PER_MILLI;
             break;
+        default:
+            return SCHEDULER_IDLE;
     }
+    render(segments);
+    return nextUpdate;
 }
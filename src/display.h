@@ -16,21 +16,33 @@ class Display {
    public:
     Display();
     void init();
-    void update();
+
+    /**
+     * @brief Sends the changed digits to the display.
+     *
+     * @return delay [us] until the shown value changes, SCHEDULER_IDLE when it is static
+     */
+    int64_t update();
+
+    /**
+     * @brief Callback invoked whenever the content changes, so update() can be scheduled.
+     */
+    void setChangeCallback(void (*callback)());
 
     void showNumber(uint16_t num);
-    void showTimeContinuously(uint32_t time);
-    void showTime(uint32_t time);
+    void showTimeContinuously(int64_t time);
+    void showTime(int64_t time);
     void showZeroTime();        
     void showConnecting();
     void showError();
 
    private:   
     TM1637Display* _tm1637;
+    alignas(TM1637Display) uint8_t _tm1637Storage[sizeof(TM1637Display)];  // constructed in init(), the constructor drives the pins
     Mode _mode;    
     uint16_t _number;
-    uint32_t _startTime;
-    uint32_t _time;
+    int64_t _startTime;
+    int64_t _time;
 
     uint8_t _frameIdx;    
     uint32_t _nextFrameMillis;
@@ -38,7 +50,14 @@ class Display {
     uint8_t _framesCount;
     uint16_t _frameDelay;
 
-    void showTimeInternal(uint32_t time);
+    uint8_t _shadow[4];  // segments currently shown
+    bool _shadowValid;
+    void (*_changeCallback)();
+
+    void changed();
+    void encodeNumber(uint16_t number, uint8_t dots, bool leadingZero, uint8_t segments[4]);
+    int64_t encodeTime(int64_t time, uint8_t segments[4]);
+    void render(const uint8_t segments[4]);
 };
 
 #endif
\ No newline at end of file
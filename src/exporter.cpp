@@ -0,0 +1,134 @@
+#include "exporter.h"
+
+#include <esp_rom_crc.h>
+
+#include "console.h"
+#include "logging.h"
+
+Exporter::Exporter() {
+    _serial = NULL;
+    _journal = NULL;
+    _recorder = NULL;
+    _task = NULL;
+    _running = false;
+    _what = 0;
+    _baud = EXPORT_BAUD;
+    _sequence = 0;
+    _frames = 0;
+    _results = 0;
+    _traceBytes = 0;
+    _chunkLength = 0;
+}
+
+void Exporter::init(HardwareSerial *serial, Journal *journal, Recorder *recorder) {
+    _serial = serial;
+    _journal = journal;
+    _recorder = recorder;
+}
+
+void Exporter::task(void *pvParameters) {
+    Exporter *exporter = (Exporter *)pvParameters;
+    exporter->_task = xTaskGetCurrentTaskHandle();
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        exporter->run();
+        exporter->_running = false;
+    }
+}
+
+bool Exporter::start(uint8_t what, uint32_t baud) {
+    if (_running || _task == NULL) {
+        return false;
+    }
+    _what = what;
+    _baud = baud;
+    _running = true;
+    xTaskNotifyGive(_task);
+    return true;
+}
+
+bool Exporter::isRunning() {
+    return _running;
+}
+
+void Exporter::run() {
+    _sequence = 0;
+    _frames = 0;
+    _results = 0;
+    _traceBytes = 0;
+    _chunkLength = 0;
+
+    // no text in the middle of the frames, the logs wait in the ring and the rest is dropped
+    DLog.pause(true);
+    Console.hold();
+
+    _serial->printf("EXPORT %u\r\n", _baud);
+    _serial->flush();
+    _serial->updateBaudRate(_baud);
+    vTaskDelay(10 / portTICK_PERIOD_MS);  // host switches the speed too
+
+    ExportHello hello = {_what, sizeof(JournalRecord), _baud};
+    sendFrame(EXPORT_FRAME_HELLO, &hello, sizeof(hello));
+
+    if (_what & EXPORT_RESULTS) {
+        JournalRecord record;
+        for (int32_t n = _journal->getCapacity() - 1; n >= 0; n--) {
+            if (_journal->get(n, record)) {
+                sendFrame(EXPORT_FRAME_RESULT, &record, sizeof(record));
+                _results++;
+            }
+        }
+    }
+    if (_what & EXPORT_TRACES) {
+        _recorder->dumpStored(this);
+    }
+    if (_what & EXPORT_LAST_TRACE) {
+        _recorder->dump(this);
+    }
+    flushTrace();
+
+    ExportEnd end = {_frames + 1, _results, _traceBytes};
+    sendFrame(EXPORT_FRAME_END, &end, sizeof(end));
+    _serial->flush();
+    _serial->updateBaudRate(115200);
+
+    Console.release();
+    DLog.pause(false);
+}
+
+void Exporter::sendFrame(uint8_t type, const void *payload, uint16_t length) {
+    ExportHeader header = {{EXPORT_SYNC0, EXPORT_SYNC1}, EXPORT_VERSION, type, _sequence++, length};
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&header.version, sizeof(header) - sizeof(header.sync));
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)payload, length);
+    _serial->write((const uint8_t *)&header, sizeof(header));  // blocks only while the TX ring buffer is full
+    _serial->write((const uint8_t *)payload, length);
+    _serial->write((const uint8_t *)&crc, sizeof(crc));
+    _frames++;
+}
+
+size_t Exporter::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t Exporter::write(const uint8_t *buffer, size_t size) {
+    size_t total = size;
+    while (size > 0) {
+        size_t chunk = min(size, (size_t)(EXPORT_CHUNK - _chunkLength));
+        memcpy(_chunk + _chunkLength, buffer, chunk);
+        _chunkLength += chunk;
+        buffer += chunk;
+        size -= chunk;
+        if (_chunkLength == EXPORT_CHUNK) {
+            flushTrace();
+        }
+    }
+    return total;
+}
+
+void Exporter::flushTrace() {
+    if (_chunkLength > 0) {
+        sendFrame(EXPORT_FRAME_TRACE, _chunk, _chunkLength);
+        _traceBytes += _chunkLength;
+        _chunkLength = 0;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef exporter_h
+#define exporter_h
+
+#include <Arduino.h>
+
+#include "journal.h"
+#include "recorder.h"
+
+#define EXPORT_BAUD 2000000       // default export speed, the USB-UART bridge of the FireBeetle handles it
+#define EXPORT_VERSION 1
+#define EXPORT_CHUNK 1024         // [B] max frame payload
+#define EXPORT_TX_BUFFER 8192     // [B] UART driver ring buffer, set before Serial.begin()
+#define EXPORT_SYNC0 0x46         // "FX"
+#define EXPORT_SYNC1 0x58
+
+// frame types
+#define EXPORT_FRAME_HELLO 0      // ExportHello
+#define EXPORT_FRAME_RESULT 1     // JournalRecord
+#define EXPORT_FRAME_TRACE 2      // part of the recorder binary stream (RecorderHeader + samples, see recorder.h)
+#define EXPORT_FRAME_END 3        // ExportEnd
+
+// what to export
+#define EXPORT_RESULTS 0x01       // the whole results journal, oldest first
+#define EXPORT_TRACES 0x02        // all stored traces
+#define EXPORT_LAST_TRACE 0x04    // the last run in RAM
+
+/**
+ * Frame header, followed by `length` bytes of payload and CRC32 (little endian) of the header
+ * without the sync bytes and the payload. The decoder resynchronizes on the sync bytes and the CRC.
+ */
+typedef struct __attribute__((packed)) ExportHeader {
+    uint8_t sync[2];
+    uint8_t version;
+    uint8_t type;
+    uint16_t sequence;
+    uint16_t length;
+} ExportHeader;
+
+typedef struct __attribute__((packed)) ExportHello {
+    uint8_t what;            // EXPORT_* bits
+    uint8_t recordSize;      // [B] JournalRecord
+    uint32_t baud;
+} ExportHello;
+
+typedef struct __attribute__((packed)) ExportEnd {
+    uint32_t frames;         // frames sent including this one
+    uint32_t results;
+    uint32_t traceBytes;
+} ExportEnd;
+
+/**
+ * Binary export of the results and traces over the serial port at a high baud rate.
+ *
+ * Runs in its own low priority task so the timing tasks and the housekeeping jobs are not blocked.
+ * The console is held for the duration, the deferred logs are printed after the export.
+ * The frames are written to the UART driver TX ring buffer which the UART interrupt drains, the
+ * Arduino core offers no DMA for the UART (UHCI), the large ring buffer serves the same purpose.
+ * Acts as a Print for the recorder, its stream is cut into EXPORT_FRAME_TRACE frames.
+ */
+class Exporter : public Print {
+   public:
+    Exporter();
+    void init(HardwareSerial *serial, Journal *journal, Recorder *recorder);
+
+    /**
+     * @brief Starts the export in the export task, false when one is running already.
+     */
+    bool start(uint8_t what, uint32_t baud);
+    bool isRunning();
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+
+    static void task(void *pvParameters);
+
+   private:
+    HardwareSerial *_serial;
+    Journal *_journal;
+    Recorder *_recorder;
+    TaskHandle_t _task;
+    volatile bool _running;
+    uint8_t _what;
+    uint32_t _baud;
+
+    uint16_t _sequence;
+    uint32_t _frames;
+    uint32_t _results;
+    uint32_t _traceBytes;
+    uint8_t _chunk[EXPORT_CHUNK];
+    uint16_t _chunkLength;
+
+    void run();
+    void sendFrame(uint8_t type, const void *payload, uint16_t length);
+    void flushTrace();
+};
+
+#endif
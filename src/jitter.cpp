@@ -0,0 +1,135 @@
+#include "jitter.h"
+
+#include "timebase.h"
+
+static StackType_t loadTaskStacks[JITTER_LOAD_TASKS][TASK_JITTER_LOAD_STACK];
+static StaticTask_t loadTaskBuffers[JITTER_LOAD_TASKS];
+
+JitterBenchmark::JitterBenchmark() {
+    _running = false;
+    _loadRunning = false;
+    _samples = JITTER_DEFAULT_SAMPLES;
+    _load = JITTER_DEFAULT_LOAD;
+    _core = SYSTEM_CORE;
+    _memoryPlan = NULL;
+    for (uint8_t i = 0; i < JITTER_LOAD_TASKS; i++) {
+        _loadTasks[i] = NULL;
+    }
+}
+
+void JitterBenchmark::init(MemoryPlan *memoryPlan) {
+    _memoryPlan = memoryPlan;
+}
+
+// the static storage of a load task of the previous benchmark is reused only after it got deleted
+bool JitterBenchmark::isLoadStopping() {
+    for (uint8_t i = 0; i < JITTER_LOAD_TASKS; i++) {
+        if (_loadTasks[i] != NULL && eTaskGetState(_loadTasks[i]) != eDeleted) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void JitterBenchmark::start(uint16_t samples, uint8_t load, uint8_t core) {
+    static const UBaseType_t loadPriorities[JITTER_LOAD_TASKS] = JITTER_LOAD_PRIORITIES;
+    if (_running || _loadRunning || _memoryPlan == NULL || isLoadStopping()) {
+        return;
+    }
+    _samples = constrain(samples, 2, JITTER_SAMPLES_MAX);
+    _load = min(load, (uint8_t)90);  // leave time to the idle task, its watchdog would fire
+    _core = core;
+    _count = 0;
+    _timeouts = 0;
+    _periodCount = 0;
+    _echoCount = 0;
+    _lastTriggerTime = 0;
+    if (_load > 0) {
+        _loadRunning = true;
+        for (uint8_t i = 0; i < JITTER_LOAD_TASKS; i++) {
+            _loadTasks[i] = _memoryPlan->createTask(loadTask, "Jitter load", TASK_JITTER_LOAD_STACK, this, loadPriorities[i], loadTaskStacks[i],
+                                                    &loadTaskBuffers[i], _core);
+        }
+    }
+    _running = true;
+}
+
+bool JitterBenchmark::isRunning() {
+    return _running;
+}
+
+bool JitterBenchmark::onSample(int64_t triggerTime, int64_t riseTime, uint16_t echoDuration) {
+    if (!_running) {
+        return false;
+    }
+    if (_lastTriggerTime != 0) {
+        _periods[_periodCount++] = (int32_t)(triggerTime - _lastTriggerTime);
+    }
+    _lastTriggerTime = triggerTime;
+    if (echoDuration == 0) {
+        _timeouts++;
+    } else {
+        _triggerToEcho[_echoCount] = (int32_t)(riseTime - triggerTime);
+        _echoDurations[_echoCount] = echoDuration;
+        _echoCount++;
+    }
+    if (++_count < _samples) {
+        return false;
+    }
+    _running = false;
+    return true;
+}
+
+// busy for the load share of every period, a short interrupt-free section once per millisecond
+void JitterBenchmark::loadTask(void *pvParameters) {
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    JitterBenchmark *benchmark = (JitterBenchmark *)pvParameters;
+    while (benchmark->_loadRunning) {
+        int64_t now = nowMicros();
+        int64_t busyUntil = now + (int64_t)JITTER_LOAD_PERIOD * MICROS_PER_MILLI * benchmark->_load / 100;
+        int64_t nextCritical = now;
+        while ((now = nowMicros()) < busyUntil) {
+            if (now >= nextCritical) {
+                portENTER_CRITICAL(&lock);
+                delayMicroseconds(JITTER_CRITICAL_SECTION);
+                portEXIT_CRITICAL(&lock);
+                nextCritical += MICROS_PER_MILLI;
+            }
+        }
+        vTaskDelay(max(1, JITTER_LOAD_PERIOD * (100 - benchmark->_load) / 100 / portTICK_PERIOD_MS));
+    }
+    vTaskDelete(NULL);
+}
+
+static int compareInt32(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a;
+    int32_t y = *(const int32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void JitterBenchmark::printDistribution(Print *output, const char *name, int32_t *values, uint16_t count) {
+    if (count == 0) {
+        output->printf("  %-16s no samples\r\n", name);
+        return;
+    }
+    qsort(values, count, sizeof(int32_t), compareInt32);
+    int32_t p1 = values[(count - 1) / 100];
+    int32_t p99 = values[(count - 1) * 99 / 100];
+    output->printf("  %-16s %7d %7d %7d %7d %7d %7d\r\n", name, values[0], p1, values[(count - 1) / 2], p99, values[count - 1], p99 - p1);
+}
+
+void JitterBenchmark::finish(Print *output) {
+    _running = false;
+    _loadRunning = false;  // the load tasks delete themselves
+    output->printf("Sampling jitter: %u samples on core %u (system core %u)", _count, TASK_DETECTOR_CORE, SYSTEM_CORE);
+    if (_load > 0) {
+        output->printf(", %u load tasks %u %% on core %u\r\n", JITTER_LOAD_TASKS, _load, _core);
+    } else {
+        output->printf(", no load\r\n");
+    }
+    output->printf("  %-16s %7s %7s %7s %7s %7s %7s [us]\r\n", "", "min", "p1", "p50", "p99", "max", "p99-p1");
+    printDistribution(output, "period", _periods, _periodCount);
+    printDistribution(output, "trigger to echo", _triggerToEcho, _echoCount);
+    printDistribution(output, "echo duration", _echoDurations, _echoCount);
+    output->printf("  echo timeouts %u\r\n", _timeouts);
+}
@@ -0,0 +1,80 @@
+#ifndef jitter_h
+#define jitter_h
+
+#include <Arduino.h>
+
+#include "memory.h"
+#include "tasks.h"
+
+#define JITTER_SAMPLES_MAX 500            // samples kept for the exact percentiles
+#define JITTER_DEFAULT_SAMPLES 500
+#define JITTER_DEFAULT_LOAD 50            // [%] CPU taken by each load task
+#define JITTER_LOAD_TASKS 3               // one per priority of JITTER_LOAD_PRIORITIES
+#define JITTER_LOAD_PRIORITIES {TASK_SCHEDULER_PRIORITY, TASK_COMMUNICATION_PRIORITY, TASK_RECEIVE_PRIORITY}
+#define JITTER_LOAD_PERIOD 10             // [ms] busy/idle cycle of a load task
+#define JITTER_CRITICAL_SECTION 30        // [us] interrupts masked once per ms (LED strip, flash writes)
+
+/**
+ * Sampling jitter benchmark.
+ *
+ * Collects the actual sample period (trigger to trigger), the trigger to echo rising edge delay and
+ * the echo duration of the detector task, optionally while synthetic load tasks keep a core busy.
+ * Run it against a static target, the spread of the echo duration is then the measurement error
+ * (the sensor itself is stable to a few us). The trigger to echo delay is meaningful with the ISR
+ * capture only, pulseIn does not stamp the rising edge.
+ */
+class JitterBenchmark {
+   public:
+    JitterBenchmark();
+
+    /**
+     * @brief The load tasks are created from static storage and reported by the plan.
+     */
+    void init(MemoryPlan *memoryPlan);
+
+    /**
+     * @brief Starts a new benchmark, previous results are discarded.
+     *
+     * @param samples number of samples, up to JITTER_SAMPLES_MAX
+     * @param load [%] duty of each load task, 0 - no load
+     * @param core core the load tasks are pinned to
+     */
+    void start(uint16_t samples, uint8_t load, uint8_t core);
+    bool isRunning();
+
+    /**
+     * @brief Sample taken by the detector task (times in us, echo 0 on timeout).
+     *
+     * @return true when the last sample was collected, finish() should be called
+     */
+    bool onSample(int64_t triggerTime, int64_t riseTime, uint16_t echoDuration);
+
+    /**
+     * @brief Stops the load and prints the results.
+     */
+    void finish(Print *output);
+
+   private:
+    volatile bool _running;
+    volatile bool _loadRunning;
+    uint16_t _samples;
+    uint8_t _load;
+    uint8_t _core;
+    MemoryPlan *_memoryPlan;
+    TaskHandle_t _loadTasks[JITTER_LOAD_TASKS];  // stay set after the tasks delete themselves
+
+    uint16_t _count;
+    uint16_t _timeouts;
+    int64_t _lastTriggerTime;
+    int32_t _periods[JITTER_SAMPLES_MAX];        // [us]
+    int32_t _triggerToEcho[JITTER_SAMPLES_MAX];  // [us]
+    int32_t _echoDurations[JITTER_SAMPLES_MAX];  // [us]
+    uint16_t _periodCount;
+    uint16_t _echoCount;
+
+    bool isLoadStopping();
+    static void loadTask(void *pvParameters);
+    void printDistribution(Print *output, const char *name, int32_t *values, uint16_t count);
+};
+
+#endif
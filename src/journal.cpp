@@ -0,0 +1,142 @@
+#include "journal.h"
+
+#include <esp_rom_crc.h>
+
+#include "logging.h"
+
+#define JOURNAL_SLOTS_PER_SECTOR (JOURNAL_SECTOR_SIZE / sizeof(JournalRecord))
+
+static_assert(sizeof(JournalRecord) == 64, "journal record must stay 64 bytes");
+
+Journal::Journal() {
+    _partition = NULL;
+    _slots = 0;
+    _head = 0;
+    _sequence = 0;
+    _boot = 0;
+    _queue = NULL;
+}
+
+void Journal::init() {
+    _queue = xQueueCreateStatic(JOURNAL_QUEUE_LENGTH, sizeof(JournalRecord), _queueStorage, &_queueBuffer);
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)JOURNAL_PARTITION_SUBTYPE, JOURNAL_PARTITION_NAME);
+    if (_partition == NULL) {
+        Log.errorln("Results partition not found");
+        return;
+    }
+    _slots = _partition->size / JOURNAL_SECTOR_SIZE * JOURNAL_SLOTS_PER_SECTOR;
+
+    // sector starting with the highest sequence, then the last written slot in it
+    uint32_t newestSector = 0;
+    uint32_t newestSequence = JOURNAL_EMPTY;
+    for (uint32_t slot = 0; slot < _slots; slot += JOURNAL_SLOTS_PER_SECTOR) {
+        uint32_t sequence = readSequence(slot);
+        if (sequence != JOURNAL_EMPTY && (newestSequence == JOURNAL_EMPTY || sequence > newestSequence)) {
+            newestSequence = sequence;
+            newestSector = slot;
+        }
+    }
+    _head = 0;
+    _sequence = 1;
+    if (newestSequence != JOURNAL_EMPTY) {
+        uint32_t slot = newestSector;
+        while (slot + 1 < newestSector + JOURNAL_SLOTS_PER_SECTOR && readSequence(slot + 1) != JOURNAL_EMPTY) {
+            slot++;
+        }
+        JournalRecord record;
+        esp_partition_read(_partition, slot * sizeof(JournalRecord), &record, sizeof(record));
+        _head = (slot + 1) % _slots;
+        _sequence = record.sequence + 1;
+        _boot = record.boot + 1;
+    }
+    prepare();
+    Log.infoln("Journal: boot %d, next record %l", _boot, (long)_sequence);
+}
+
+uint32_t Journal::readSequence(uint32_t slot) {
+    uint32_t sequence;
+    esp_partition_read(_partition, slot * sizeof(JournalRecord), &sequence, sizeof(sequence));
+    return sequence;
+}
+
+// keeps the sector after the head erased, it holds the oldest records
+void Journal::prepare() {
+    if (_head % JOURNAL_SLOTS_PER_SECTOR == 0 && readSequence(_head) != JOURNAL_EMPTY) {
+        // the head sector itself was not prepared (power loss during the erase)
+        esp_partition_erase_range(_partition, _head * sizeof(JournalRecord), JOURNAL_SECTOR_SIZE);
+    }
+    uint32_t next = (_head / JOURNAL_SLOTS_PER_SECTOR + 1) * JOURNAL_SLOTS_PER_SECTOR % _slots;
+    if (readSequence(next) != JOURNAL_EMPTY) {
+        esp_partition_erase_range(_partition, next * sizeof(JournalRecord), JOURNAL_SECTOR_SIZE);
+    }
+}
+
+uint32_t Journal::computeCrc(const JournalRecord &record) {
+    return esp_rom_crc32_le(0, (const uint8_t *)&record, offsetof(JournalRecord, crc));
+}
+
+bool Journal::submit(const JournalRecord &record) {
+    if (xQueueSend(_queue, &record, 0) != pdTRUE) {
+        DLog.errorln("Journal queue full, result not stored");
+        return false;
+    }
+    return true;
+}
+
+void Journal::append(JournalRecord &record) {
+    if (_partition == NULL) {
+        return;
+    }
+    record.sequence = _sequence++;
+    record.boot = _boot;
+    memset(record.reserved, 0xff, sizeof(record.reserved));
+    record.crc = computeCrc(record);
+    esp_partition_write(_partition, _head * sizeof(JournalRecord), &record, sizeof(record));
+    _head = (_head + 1) % _slots;
+    if (_head % JOURNAL_SLOTS_PER_SECTOR == 0) {
+        prepare();  // entering a new sector, erase the one after it
+    }
+}
+
+void Journal::task(void *pvParameters) {
+    Journal *journal = (Journal *)pvParameters;
+    JournalRecord record;
+    while (1) {
+        if (xQueueReceive(journal->_queue, &record, portMAX_DELAY) == pdTRUE) {
+            journal->append(record);
+        }
+    }
+}
+
+bool Journal::get(uint16_t n, JournalRecord &record) {
+    if (_partition == NULL || n >= getCapacity()) {
+        return false;
+    }
+    uint32_t slot = (_head + _slots - 1 - n) % _slots;
+    esp_partition_read(_partition, slot * sizeof(JournalRecord), &record, sizeof(record));
+    return record.sequence != JOURNAL_EMPTY && record.crc == computeCrc(record);
+}
+
+// the prepared sector is never readable
+uint32_t Journal::getCapacity() {
+    return _slots > JOURNAL_SLOTS_PER_SECTOR ? _slots - JOURNAL_SLOTS_PER_SECTOR : 0;
+}
+
+void Journal::print(Print *output, uint16_t count) {
+    JournalRecord record;
+    for (uint16_t n = 0; n < count && n < getCapacity(); n++) {
+        if (!get(n, record)) {
+            if (record.sequence == JOURNAL_EMPTY) {
+                break;
+            }
+            continue;  // torn record
+        }
+        output->printf("#%u boot %u run %u: %.3f s", record.sequence, record.boot, record.run, record.time / 1e6);
+        for (uint8_t i = 0; i < JOURNAL_SPLITS; i++) {
+            if (record.splits[i] != 0) {
+                output->printf(", split %u %.3f s", i + 1, record.splits[i] / 1e6);
+            }
+        }
+        output->printf("%s\r\n", record.flags & JOURNAL_FLAG_PIPELINE ? " (pipeline)" : "");
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef journal_h
+#define journal_h
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#define JOURNAL_PARTITION_NAME "results"
+#define JOURNAL_PARTITION_SUBTYPE 0x41
+#define JOURNAL_SECTOR_SIZE 4096
+#define JOURNAL_SPLITS 8             // split gates kept per result
+#define JOURNAL_EMPTY 0xffffffff     // sequence of an erased slot
+#define JOURNAL_QUEUE_LENGTH 8       // results waiting for the journal task
+
+// JournalRecord.flags
+#define JOURNAL_FLAG_PIPELINE 0x01   // run started in the pipeline mode
+
+/**
+ * Result record, 64 bytes, so a sector holds 64 of them and a record never crosses a sector.
+ */
+typedef struct JournalRecord {
+    uint32_t sequence;               // increasing over the whole journal
+    uint16_t boot;                   // power cycle counter, startTime is relative to it
+    uint16_t run;
+    int64_t startTime;               // [us] since the boot
+    int32_t time;                    // [us] final time
+    int32_t splits[JOURNAL_SPLITS];  // [us] since the start, 0 when the gate was not passed
+    uint8_t flags;                   // JOURNAL_FLAG_* bits
+    uint8_t reserved[7];
+    uint32_t crc;                    // CRC32 of the preceding bytes
+} JournalRecord;
+
+/**
+ * Append-only results journal in the "results" flash partition.
+ *
+ * Records are written one after another around the partition, so every sector is erased once per
+ * round (wear leveling). The sector following the one being written is kept erased in advance, an
+ * append is then a single 64 byte write. A record torn by a power loss fails its CRC and is skipped.
+ * The position of the newest record is found at boot by reading the first record of each sector
+ * and scanning the newest sector.
+ */
+class Journal {
+   public:
+    Journal();
+    void init();
+
+    /**
+     * @brief Queues the result for the journal task, callable from any task, the sequence/boot/crc are filled in later.
+     */
+    bool submit(const JournalRecord &record);
+
+    /**
+     * @brief Writes the result and erases the next sector when needed (tens to hundreds of ms), the
+     * journal task appends the submitted results.
+     */
+    void append(JournalRecord &record);
+
+    /**
+     * @brief Reads the n-th newest result (0 is the newest), false when there is no such valid record.
+     */
+    bool get(uint16_t n, JournalRecord &record);
+    uint32_t getCapacity();
+
+    void print(Print *output, uint16_t count);
+
+    /**
+     * @brief Low priority task writing the submitted results, the flash erase never delays the scheduler jobs.
+     */
+    static void task(void *pvParameters);
+
+   private:
+    const esp_partition_t *_partition;
+    uint32_t _slots;
+    uint32_t _head;  // slot of the next record
+    uint32_t _sequence;
+    uint16_t _boot;
+    QueueHandle_t _queue;
+    StaticQueue_t _queueBuffer;
+    uint8_t _queueStorage[JOURNAL_QUEUE_LENGTH * sizeof(JournalRecord)];
+
+    uint32_t readSequence(uint32_t slot);
+    void prepare();
+    static uint32_t computeCrc(const JournalRecord &record);
+};
+
+#endif
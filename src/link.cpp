@@ -0,0 +1,263 @@
+#include "link.h"
+
+#include "logging.h"
+#include "timebase.h"
+
+Link::Link() {
+    _peers = NULL;
+    _tracer = NULL;
+    _session = 0;
+    memset(_sequences, 0, sizeof(_sequences));
+    for (uint8_t i = 0; i < LINK_PENDING_MAX; i++) {
+        _pending[i].used = false;
+    }
+    _failureCallback = NULL;
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+    memset(_windows, 0, sizeof(_windows));
+    _retransmits = 0;
+    _failures = 0;
+    _duplicates = 0;
+    _invalid = 0;
+}
+
+void Link::init(PeerTable *peers, LatencyTracer *tracer) {
+    _peers = peers;
+    _tracer = tracer;
+    _session = esp_random();
+}
+
+void Link::setFailureCallback(LinkFailureCallback callback) {
+    _failureCallback = callback;
+}
+
+// INIT is repeated until answered, sync and benchmark frames are worthless when late
+bool Link::isReliable(Event event) {
+    switch (event) {
+        case EVENT_BUTTON_RESET:
+        case EVENT_MESSAGE_ACK:
+        case EVENT_MESSAGE_FINISH:
+        case EVENT_DETECTOR_OBJECT_ARRIVED:
+        case EVENT_RUN_CONFIRMED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool Link::send(Message &message) {
+    if (message.peer == PEER_BROADCAST || (message.peer < PEERS_MAX && !isReliable(message.event))) {
+        return transmit(message.peer, 0, 0, message);
+    }
+    if (message.peer < PEERS_MAX) {
+        return sendReliable(message.peer, message);
+    }
+    // PEER_DEFAULT
+    if (_peers->getRole() != ROLE_START) {
+        int8_t start = _peers->findRole(ROLE_START);
+        if (start < 0) {
+            return false;  // not discovered yet
+        }
+        return isReliable(message.event) ? sendReliable(start, message) : transmit(start, 0, 0, message);
+    }
+    bool result = true;
+    for (uint8_t peer = 0; peer < _peers->getCount(); peer++) {
+        result &= isReliable(message.event) ? sendReliable(peer, message) : transmit(peer, 0, 0, message);
+    }
+    return result;
+}
+
+bool Link::sendReliable(uint8_t peer, Message &message) {
+    int64_t now = nowMicros();
+    uint16_t sequence = 0;
+    bool stored = false;
+    portENTER_CRITICAL(&_lock);
+    for (uint8_t i = 0; i < LINK_PENDING_MAX; i++) {
+        if (!_pending[i].used) {
+            sequence = ++_sequences[peer];
+            _pending[i].used = true;
+            _pending[i].peer = peer;
+            _pending[i].sequence = sequence;
+            _pending[i].message = message;
+            _pending[i].message.peer = peer;
+            _pending[i].firstSendTime = now;
+            _pending[i].lastSendTime = now;
+            stored = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_lock);
+    if (!stored) {
+        DLog.errorln("Link: too many unacknowledged frames, %s sent unreliably", eventName(message.event));
+        return transmit(peer, 0, 0, message);
+    }
+    return transmit(peer, FRAME_FLAG_RELIABLE, sequence, message);
+}
+
+int64_t Link::retransmit() {
+    PendingFrame due[LINK_PENDING_MAX];
+    uint8_t dueCount = 0;
+    PendingFrame expired[LINK_PENDING_MAX];
+    uint8_t expiredCount = 0;
+    int64_t delay = LINK_IDLE;
+    int64_t now = nowMicros();
+
+    portENTER_CRITICAL(&_lock);
+    for (uint8_t i = 0; i < LINK_PENDING_MAX; i++) {
+        PendingFrame &frame = _pending[i];
+        if (!frame.used) {
+            continue;
+        }
+        if (now - frame.firstSendTime >= LINK_LATENCY_BUDGET * MICROS_PER_MILLI) {
+            expired[expiredCount++] = frame;
+            frame.used = false;
+            continue;
+        }
+        int64_t frameDelay = frame.lastSendTime + LINK_RETRY_INTERVAL * MICROS_PER_MILLI - now;
+        if (frameDelay <= 0) {
+            due[dueCount++] = frame;
+            frame.lastSendTime = now;
+            frameDelay = LINK_RETRY_INTERVAL * MICROS_PER_MILLI;
+        }
+        if (delay == LINK_IDLE || frameDelay < delay) {
+            delay = frameDelay;
+        }
+    }
+    portEXIT_CRITICAL(&_lock);
+
+    for (uint8_t i = 0; i < dueCount; i++) {
+        _retransmits++;
+        transmit(due[i].peer, FRAME_FLAG_RELIABLE, due[i].sequence, due[i].message);
+    }
+    for (uint8_t i = 0; i < expiredCount; i++) {
+        _failures++;
+        DLog.errorln("Link: %s not acknowledged", eventName(expired[i].message.event));
+        if (_failureCallback != NULL) {
+            _failureCallback(expired[i].message);
+        }
+    }
+    return delay;
+}
+
+bool Link::transmit(uint8_t peer, uint8_t flags, uint16_t sequence, Message &message) {
+    static const uint8_t broadcastAddress[ESP_NOW_ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    static uint8_t frame[ESP_NOW_MAX_DATA_LEN];  // benchmark frames are padded, used by the communication task only
+    size_t size = sizeof(FrameHeader) + sizeof(FramePayload);
+    if (message.event == EVENT_BENCH_PING || message.event == EVENT_BENCH_PONG) {
+        size = constrain(message.size, size, ESP_NOW_MAX_DATA_LEN);
+    }
+    message.sendTime = nowMicros();
+
+    FrameHeader header = {LINK_VERSION, FRAME_TYPE_DATA, flags, _session, sequence, (uint16_t)(size - sizeof(FrameHeader))};
+    FramePayload payload = {(uint8_t)message.event, message.time, message.receiveTime, message.sendTime, message.size, message.run,
+                            _peers->getRole(), _peers->getGate(), message.trace, message.traceOrigin};
+    memcpy(frame, &header, sizeof(header));
+    memcpy(frame + sizeof(header), &payload, sizeof(payload));
+    const uint8_t *address = peer == PEER_BROADCAST ? broadcastAddress : _peers->get(peer).address;
+    _tracer->mark(message, TRACE_SEND);
+    uint8_t ticket = _tracer->onTransmit(&message);  // before sending, the callback may come first
+    esp_err_t result = esp_now_send(address, frame, size);
+    if (result != ESP_OK) {
+        _tracer->cancel(ticket);
+        DLog.errorln("Error sending the data");
+        return false;
+    }
+    return true;
+}
+
+void Link::sendAck(const uint8_t *address, uint8_t session, uint16_t sequence) {
+    FrameHeader header = {LINK_VERSION, FRAME_TYPE_ACK, 0, session, sequence, 0};
+    uint8_t ticket = _tracer->onTransmit(NULL);
+    if (esp_now_send(address, (uint8_t *)&header, sizeof(header)) != ESP_OK) {
+        _tracer->cancel(ticket);
+    }
+}
+
+bool Link::receive(const uint8_t *address, const uint8_t *data, int len, Message &message) {
+    FrameHeader header;
+    if (len < (int)sizeof(header)) {
+        _invalid++;
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.version != LINK_VERSION || header.length != len - sizeof(header)) {
+        _invalid++;
+        return false;
+    }
+    int8_t peer = _peers->find(address);
+
+    if (header.type == FRAME_TYPE_ACK) {
+        portENTER_CRITICAL(&_lock);
+        for (uint8_t i = 0; i < LINK_PENDING_MAX; i++) {
+            if (_pending[i].used && _pending[i].peer == peer && _pending[i].sequence == header.sequence && header.session == _session) {
+                _pending[i].used = false;
+            }
+        }
+        portEXIT_CRITICAL(&_lock);
+        return false;
+    }
+
+    FramePayload payload;
+    if (header.type != FRAME_TYPE_DATA || header.length < sizeof(payload)) {
+        _invalid++;
+        return false;
+    }
+    memcpy(&payload, data + sizeof(header), sizeof(payload));
+    if (peer < 0 && payload.event != EVENT_ANNOUNCE) {
+        return false;  // not discovered yet
+    }
+    if (peer >= 0 && (header.flags & FRAME_FLAG_RELIABLE)) {
+        sendAck(address, header.session, header.sequence);  // duplicates too, the previous ACK might got lost
+        if (isDuplicate(peer, header.session, header.sequence)) {
+            _duplicates++;
+            return false;
+        }
+    }
+    message.event = (Event)payload.event;
+    message.time = payload.time;
+    message.receiveTime = payload.receiveTime;
+    message.sendTime = payload.sendTime;
+    message.size = payload.size;
+    message.run = payload.run;
+    message.peer = peer < 0 ? PEER_UNKNOWN : peer;
+    message.role = payload.role;
+    message.gate = payload.gate;
+    message.trace = payload.trace;
+    message.traceOrigin = payload.traceOrigin;
+    return true;
+}
+
+// sliding window of the received sequences, restarted when the peer reboots (new session)
+bool Link::isDuplicate(uint8_t peer, uint8_t session, uint16_t sequence) {
+    PeerWindow &window = _windows[peer];
+    if (!window.known || session != window.session) {
+        window.known = true;
+        window.session = session;
+        window.sequence = sequence;
+        window.mask = 1;
+        return false;
+    }
+    int16_t diff = (int16_t)(sequence - window.sequence);
+    if (diff > 0) {
+        window.mask = diff >= LINK_DEDUP_WINDOW ? 1 : (window.mask << diff) | 1;
+        window.sequence = sequence;
+        return false;
+    }
+    if (-diff >= LINK_DEDUP_WINDOW) {
+        return true;  // too old, surely received already
+    }
+    uint32_t bit = 1UL << -diff;
+    if (window.mask & bit) {
+        return true;
+    }
+    window.mask |= bit;
+    return false;
+}
+
+void Link::printStatistics(Print *output) {
+    uint8_t pending = 0;
+    for (uint8_t i = 0; i < LINK_PENDING_MAX; i++) {
+        pending += _pending[i].used ? 1 : 0;
+    }
+    output->printf("Link: retransmits %u, failures %u, duplicates %u, invalid %u, pending %u\r\n", _retransmits, _failures, _duplicates,
+                   _invalid, pending);
+}
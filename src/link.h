@@ -0,0 +1,134 @@
+#ifndef link_h
+#define link_h
+
+#include <Arduino.h>
+#include <esp_now.h>
+
+#include "message.h"
+#include "peers.h"
+#include "tracer.h"
+
+#define LINK_VERSION 4
+#define LINK_PENDING_MAX 24       // reliable frames waiting for their ACK, one per destination
+#define LINK_RETRY_INTERVAL 15    // [ms] retransmit when not acknowledged within
+#define LINK_LATENCY_BUDGET 250   // [ms] give up (EVENT_SEND_ERROR) when not acknowledged within
+#define LINK_DEDUP_WINDOW 32      // reliable sequences remembered by the receiver
+#define LINK_IDLE -1              // retransmit() - nothing is pending
+
+#define FRAME_TYPE_DATA 0
+#define FRAME_TYPE_ACK 1
+#define FRAME_FLAG_RELIABLE 0x01
+
+/**
+ * Frame header, all frames start with it.
+ * Reliable frames are numbered per destination, unreliable ones (periodic or timing sensitive) carry sequence 0.
+ * The session is random per boot, the receiver restarts the deduplication when it changes.
+ */
+typedef struct __attribute__((packed)) FrameHeader {
+    uint8_t version;
+    uint8_t type;
+    uint8_t flags;
+    uint8_t session;
+    uint16_t sequence;
+    uint16_t length;  // [B] payload following the header
+} FrameHeader;
+
+/**
+ * Message on air, independent of the in-memory layout of Message.
+ */
+typedef struct __attribute__((packed)) FramePayload {
+    uint8_t event;
+    int64_t time;
+    int64_t receiveTime;
+    int64_t sendTime;
+    uint16_t size;
+    uint16_t run;
+    uint8_t role;
+    uint8_t gate;
+    uint16_t trace;
+    int64_t traceOrigin;
+} FramePayload;
+
+typedef struct PendingFrame {
+    bool used;
+    uint8_t peer;
+    uint16_t sequence;
+    Message message;
+    int64_t firstSendTime;  // [us]
+    int64_t lastSendTime;   // [us]
+} PendingFrame;
+
+// received reliable sequences of a peer
+typedef struct PeerWindow {
+    bool known;
+    uint8_t session;
+    uint16_t sequence;  // highest received
+    uint32_t mask;      // bit i - sequence - i received
+} PeerWindow;
+
+typedef void (*LinkFailureCallback)(Message &message);
+
+/**
+ * Framed ESP-NOW link - versioned frames, ACKed and selectively retransmitted reliable messages,
+ * deduplication on the receiver side. Message.peer selects the destination (a reliable message sent
+ * to several peers is acknowledged by each of them separately) and tells the source.
+ *
+ * The event times are absolute (start device clock) or durations, so they stay valid when a frame
+ * is retransmitted; sendTime is stamped again on every transmission.
+ */
+class Link {
+   public:
+    Link();
+    void init(PeerTable *peers, LatencyTracer *tracer);
+
+    /**
+     * @brief Called with the message given up after LINK_LATENCY_BUDGET, message.peer is the destination.
+     */
+    void setFailureCallback(LinkFailureCallback callback);
+
+    /**
+     * @brief Sends the message, the reliable ones are kept until acknowledged.
+     */
+    bool send(Message &message);
+
+    /**
+     * @brief Retransmits the unacknowledged frames that are due, gives up the expired ones.
+     *
+     * @return delay until the next retransmission [us] or LINK_IDLE
+     */
+    int64_t retransmit();
+
+    /**
+     * @brief Validates and decodes the received frame, acknowledges the reliable ones.
+     * Senders missing in the peer table get through with EVENT_ANNOUNCE only (PEER_UNKNOWN source).
+     *
+     * @return true when the message should be processed (not an ACK, invalid frame or duplicate)
+     */
+    bool receive(const uint8_t *address, const uint8_t *data, int len, Message &message);
+
+    static bool isReliable(Event event);
+    void printStatistics(Print *output);
+
+   private:
+    PeerTable *_peers;
+    LatencyTracer *_tracer;
+    uint8_t _session;
+    uint16_t _sequences[PEERS_MAX];  // per destination, the receiver window sees no gaps
+    PendingFrame _pending[LINK_PENDING_MAX];
+    LinkFailureCallback _failureCallback;
+    portMUX_TYPE _lock;
+
+    PeerWindow _windows[PEERS_MAX];  // deduplication, touched by the receive task only
+
+    uint32_t _retransmits;
+    uint32_t _failures;
+    uint32_t _duplicates;
+    uint32_t _invalid;
+
+    bool sendReliable(uint8_t peer, Message &message);
+    bool transmit(uint8_t peer, uint8_t flags, uint16_t sequence, Message &message);
+    void sendAck(const uint8_t *address, uint8_t session, uint16_t sequence);
+    bool isDuplicate(uint8_t peer, uint8_t session, uint16_t sequence);
+};
+
+#endif
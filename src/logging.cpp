@@ -1,11 +1,19 @@
 #include "logging.h"
 
+#include "timebase.h"
+
 void printPrefix(Print* _logOutput, int logLevel) {
     printTimestamp(_logOutput);
     printLogLevel (_logOutput, logLevel);
 }
 
+static void printTime(Print* _logOutput, unsigned long msecs);
+
 void printTimestamp(Print* _logOutput) {
+  printTime(_logOutput, millis());
+}
+
+static void printTime(Print* _logOutput, unsigned long msecs) {
 
   // Division constants
   const unsigned long MSECS_PER_SEC       = 1000;
@@ -14,7 +22,6 @@ void printTimestamp(Print* _logOutput) {
   const unsigned long SECS_PER_DAY        = 86400;
 
   // Total time
-  const unsigned long msecs               =  millis() ;
   const unsigned long secs                =  msecs / MSECS_PER_SEC;
 
   // Time in components
@@ -42,4 +49,219 @@ void printLogLevel(Print* _logOutput, int logLevel) {
         case 5:_logOutput->print("TRACE   "); break;
         case 6:_logOutput->print("VERBOSE "); break;
     }   
-}
\ No newline at end of file
+}
+
+DeferredLogging DLog;
+
+DeferredLogging::DeferredLogging() {
+    for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+        _ring[i].sequence = i;
+    }
+    _enqueuePosition = 0;
+    _dequeuePosition = 0;
+    _dropped = 0;
+    _reportedDropped = 0;
+    _level = LOG_LEVEL_SILENT;
+    _output = NULL;
+    _paused = false;
+    _printing = false;
+}
+
+void DeferredLogging::begin(int level, Print *output) {
+    _level = level;
+    _output = output;
+}
+
+void DeferredLogging::setLevel(int level) {
+    _level = level;
+}
+
+void DeferredLogging::errorln(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    push(LOG_LEVEL_ERROR, format, args);
+    va_end(args);
+}
+
+void DeferredLogging::warningln(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    push(LOG_LEVEL_WARNING, format, args);
+    va_end(args);
+}
+
+void DeferredLogging::infoln(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    push(LOG_LEVEL_INFO, format, args);
+    va_end(args);
+}
+
+void DeferredLogging::traceln(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    push(LOG_LEVEL_TRACE, format, args);
+    va_end(args);
+}
+
+// bounded multi-producer ring, every slot carries the position it is ready for (Vyukov)
+void DeferredLogging::push(uint8_t level, const char *format, va_list args) {
+    if (level > _level) {
+        return;
+    }
+    uint32_t position = __atomic_load_n(&_enqueuePosition, __ATOMIC_RELAXED);
+    LogRecord *record;
+    while (1) {
+        record = &_ring[position % LOG_RING_SIZE];
+        int32_t diff = (int32_t)(__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) - position);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&_enqueuePosition, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&_dropped, 1, __ATOMIC_RELAXED);  // full
+            return;
+        } else {
+            position = __atomic_load_n(&_enqueuePosition, __ATOMIC_RELAXED);
+        }
+    }
+
+    record->format = format;
+    record->time = nowMicros();
+    record->level = level;
+    record->argCount = 0;
+    for (const char *c = format; *c != 0 && record->argCount < LOG_RECORD_ARGS; c++) {
+        if (*c != '%') {
+            continue;
+        }
+        switch (*++c) {
+            case 's':
+                record->args[record->argCount++].s = va_arg(args, const char *);
+                break;
+            case 'F':
+            case 'D':
+                record->args[record->argCount++].f = va_arg(args, double);
+                break;
+            case 'd':
+            case 'i':
+            case 'l':
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'c':
+            case 't':
+            case 'T':
+                record->args[record->argCount++].i = va_arg(args, int32_t);
+                break;
+            case 0:
+                c--;
+                break;
+        }
+    }
+    __atomic_store_n(&record->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+// single consumer, the drain task
+bool DeferredLogging::drain() {
+    bool drained = false;
+    while (1) {
+        _printing = true;
+        if (_paused) {
+            _printing = false;
+            return false;
+        }
+        LogRecord *slot = &_ring[_dequeuePosition % LOG_RING_SIZE];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != _dequeuePosition + 1) {
+            _printing = false;
+            break;
+        }
+        LogRecord record = *slot;
+        __atomic_store_n(&slot->sequence, _dequeuePosition + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        _dequeuePosition++;
+        if (_output != NULL) {
+            print(record);
+        }
+        _printing = false;
+        drained = true;
+    }
+    uint32_t dropped = getDropped();
+    if (dropped != _reportedDropped && _output != NULL) {
+        _output->printf("%u log records dropped\r\n", (unsigned)(dropped - _reportedDropped));
+        _reportedDropped = dropped;
+    }
+    return drained;
+}
+
+void DeferredLogging::pause(bool paused) {
+    _paused = paused;
+    while (paused && _printing) {
+        vTaskDelay(1);
+    }
+}
+
+uint32_t DeferredLogging::getDropped() {
+    return __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+}
+
+void DeferredLogging::print(const LogRecord &record) {
+    printTime(_output, record.time / 1000);
+    printLogLevel(_output, record.level);
+    uint8_t arg = 0;
+    for (const char *c = record.format; *c != 0; c++) {
+        const char *next = strchr(c, '%');
+        if (next == NULL || next[1] == 0) {
+            _output->print(c);
+            break;
+        }
+        _output->write((const uint8_t *)c, next - c);
+        c = next + 1;
+        char specifier = *c;
+        if (specifier == '%') {
+            _output->print('%');
+            continue;
+        }
+        if (strchr("sFDdilxXuctT", specifier) == NULL || arg >= record.argCount) {
+            _output->print('%');
+            _output->print(specifier);
+            continue;
+        }
+        switch (specifier) {
+            case 's':
+                _output->print(record.args[arg].s);
+                break;
+            case 'F':
+            case 'D':
+                _output->print(record.args[arg].f);
+                break;
+            case 'x':
+            case 'X':
+                _output->print((uint32_t)record.args[arg].i, HEX);
+                break;
+            case 'u':
+                _output->print((uint32_t)record.args[arg].i);
+                break;
+            case 'c':
+                _output->print((char)record.args[arg].i);
+                break;
+            case 't':
+                _output->print(record.args[arg].i ? 'T' : 'F');
+                break;
+            case 'T':
+                _output->print(record.args[arg].i ? "true" : "false");
+                break;
+            default:
+                _output->print(record.args[arg].i);
+                break;
+        }
+        arg++;
+    }
+    _output->print("\r\n");
+}
+
+void DeferredLogging::task(void *pvParameters) {
+    while (1) {
+        if (!DLog.drain()) {
+            vTaskDelay(LOG_DRAIN_PERIOD / portTICK_PERIOD_MS);
+        }
+    }
+}
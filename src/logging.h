@@ -3,9 +3,80 @@
 
 #include <Arduino.h>
 #include <ArduinoLog.h>
+#include <stdarg.h>
+
+#define LOG_RING_SIZE 64         // records, power of 2
+#define LOG_RECORD_ARGS 4        // arguments kept per record, the rest is dropped
+#define LOG_DRAIN_PERIOD 20      // [ms] drain task wakeup when the ring is empty
 
 extern void printPrefix(Print* _logOutput, int logLevel);
 extern void printTimestamp(Print* _logOutput);
 extern void printLogLevel(Print* _logOutput, int logLevel);
 
-#endif
\ No newline at end of file
+/**
+ * Deferred log record - the format string (it has to stay valid, literals only) works as the
+ * format id, the arguments are copied raw. %s arguments must be static strings as well.
+ */
+typedef struct LogRecord {
+    uint32_t sequence;  // ring slot state
+    const char *format;
+    int64_t time;       // [us]
+    uint8_t level;
+    uint8_t argCount;
+    union {
+        int32_t i;
+        const char *s;
+        double f;
+    } args[LOG_RECORD_ARGS];
+} LogRecord;
+
+/**
+ * Logging for the task paths (WiFi callbacks, sampling, state machine, communication, scheduler jobs).
+ *
+ * The calls only copy a small binary record into a lock-free ring (safe from any task on both cores),
+ * a low priority task formats and prints the records later. Records are dropped and counted when
+ * the ring is full, the producer never waits for the UART. Supports the ArduinoLog specifiers
+ * %d %i %l %u %x %X %c %s %t %T %F %D, everything else is printed verbatim.
+ */
+class DeferredLogging {
+   public:
+    DeferredLogging();
+    void begin(int level, Print *output);
+    void setLevel(int level);
+
+    void errorln(const char *format, ...);
+    void warningln(const char *format, ...);
+    void infoln(const char *format, ...);
+    void traceln(const char *format, ...);
+
+    /**
+     * @brief Prints the queued records, returns false when there were none (or paused).
+     */
+    bool drain();
+
+    /**
+     * @brief Stops/resumes printing, the records stay queued. Pausing waits for the record being printed.
+     */
+    void pause(bool paused);
+    uint32_t getDropped();
+
+    static void task(void *pvParameters);
+
+   private:
+    LogRecord _ring[LOG_RING_SIZE];
+    uint32_t _enqueuePosition;
+    uint32_t _dequeuePosition;
+    uint32_t _dropped;
+    uint32_t _reportedDropped;
+    int _level;
+    Print *_output;
+    volatile bool _paused;
+    volatile bool _printing;
+
+    void push(uint8_t level, const char *format, va_list args);
+    void print(const LogRecord &record);
+};
+
+extern DeferredLogging DLog;
+
+#endif
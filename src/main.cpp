@@ -8,16 +8,39 @@
 #include <esp_wifi.h>
 
 #include "battery.h"
+#include "benchmark.h"
+#include "clocksync.h"
+#include "console.h"
 #include "detector.h"
 #include "display.h"
+#include "exporter.h"
+#include "jitter.h"
+#include "link.h"
+#include "journal.h"
 #include "logging.h"
+#include "memory.h"
+#include "message.h"
+#include "peers.h"
+#include "power.h"
+#include "recorder.h"
 #include "rgbled.h"
+#include "runqueue.h"
+#include "sampling.h"
+#include "rxring.h"
+#include "scheduler.h"
+#include "statemachine.h"
+#include "tasks.h"
+#include "timebase.h"
+#include "tracer.h"
 
 // Constants
-#define DEVICE_TYPE 0  // defines whether is it start (0) or finish (1) device 
+#define DEVICE_TYPE 0  // role used until one is stored in NVS (serial command role) - start (0), finish (1) or split (2) device
 
 #define RESET_BUTTON_PIN 0  // ext. reset button pin
 
+#define RUN_CONFIRMATION_TIME 100000  // [us] minimum run time, avoids false start
+#define FINISH_TIMEOUT 8000000        // [us] how long the result stays on display
+
 typedef enum {
     STATE_UNKNOWN,
     STATE_START,
@@ -38,366 +61,820 @@ const char *stateName(State state) {
     }
 }
 
-typedef enum {
-    EVENT_SEND_ERROR,
-    EVENT_BUTTON_RESET,
-    EVENT_MESSAGE_INIT,
-    EVENT_MESSAGE_ACK,
-    EVENT_MESSAGE_FINISH,
-    EVENT_DETECTOR_OBJECT_LEFT,
-    EVENT_DETECTOR_OBJECT_ARRIVED,
-    EVENT_RUN_CONFIRMED,
-    EVENT_TIMEOUT
-} Event;
-
-// used for logging/debuggin purposes
-const char *eventName(Event event) {
-    static char const *eventNames[9] = {"EVENT_SEND_ERROR", "EVENT_BUTTON_RESET", "EVENT_MESSAGE_INIT", "EVENT_MESSAGE_ACK", "EVENT_MESSAGE_FINISH",
-                                        "EVENT_DETECTOR_OBJECT_LEFT", "EVENT_DETECTOR_OBJECT_ARRIVED", "EVENT_RUN_CONFIRMED", "EVENT_TIMEOUT"};
-    if (event >= 0 && event < 9) {
-        return eventNames[event];
-    } else {
-        return "UNDEFINED";
-    }
-}
-
-// Types
-typedef struct Message {
-    Event event;
-    unsigned long time;
-} Message;
-
 // Global Variables
-State currentState = STATE_UNKNOWN;
-uint32_t stateChangeTime = 0;
+StateMachine stateMachine;
 RgbLed rgbLed;
 Bounce bounce;
 Display display;
 Battery battery;
 Detector detector;
-uint32_t startTime = 0;
-uint32_t measuredTime = 0;
+SamplingScheduler sampling;
+ClockSync clockSync;  // start device clock estimate, used by the finish device only
+LinkBenchmark linkBenchmark;
+JitterBenchmark jitterBenchmark;
+Recorder recorder;
+Journal journal;
+Exporter exporter;
+Power power;
+Scheduler scheduler;
+Link link;
+PeerTable peers;
+LatencyTracer tracer;
+ReceiveRing receiveRing;
+MemoryPlan memoryPlan;
+int8_t displayJobId = -1;
+int8_t persistTraceJobId = -1;
+int8_t linkBenchmarkJobId = -1;
+int8_t jitterBenchmarkJobId = -1;
+int8_t discoveryJobId = -1;
+int64_t startTime = 0;
+int64_t measuredTime = 0;
+RunQueue runs;             // runs on course, start order
+uint16_t lastRunId = 0;
+bool pipelineMode = false;  // start device arms the next run while the previous ones are on course
 
 QueueHandle_t sendQueue;
 QueueHandle_t stateMachineEventQueue;
-
-uint8_t startDeviceAddress[] = {0x08, 0x3A, 0xF2, 0x3A, 0x81, 0xFC};   // white
-uint8_t finishDeviceAddress[] = {0x08, 0x3A, 0xF2, 0x3A, 0x81, 0x60};  // red
-// uint8_t finishDeviceAddress[] = {0x08, 0x3A, 0xF2, 0x3A, 0x5D, 0xA0}; //breadboard
-esp_now_peer_info_t peerInfo;
+TaskHandle_t readDetectorTaskHandle = NULL;
+
+// static task stacks and queue storage, sizes in tasks.h
+STATIC_QUEUE(sendQueue, SEND_QUEUE_LENGTH, Message);
+STATIC_QUEUE(stateMachineQueue, STATE_MACHINE_QUEUE_LENGTH, Message);
+STATIC_TASK(receiveTask, TASK_RECEIVE_STACK);
+STATIC_TASK(schedulerTask, TASK_SCHEDULER_STACK);
+STATIC_TASK(stateMachineTask, TASK_STATE_MACHINE_STACK);
+STATIC_TASK(readDetectorTask, TASK_DETECTOR_STACK);
+STATIC_TASK(communicationTask, TASK_COMMUNICATION_STACK);
+STATIC_TASK(exportTask, TASK_EXPORT_STACK);
+STATIC_TASK(journalTask, TASK_JOURNAL_STACK);
+STATIC_TASK(logTask, TASK_LOG_STACK);
 
 /**
  * Specifies whether is the start (master) device or not.
- * Usually based on harware configuration.
+ * The role is stored in NVS, see the role serial command.
  */
 boolean isStartDevice() {
-    return DEVICE_TYPE == 0;
+    return peers.getRole() == ROLE_START;
+}
+
+State currentState() {
+    return (State)stateMachine.getState();
+}
+
+/**
+ * Converts the local timestamp to the start device clock, all absolute times exchanged
+ * between the devices are in that clock domain.
+ */
+int64_t toStartDeviceTime(int64_t localTime) {
+    if (isStartDevice()) {
+        return localTime;
+    }
+    return clockSync.toPeerTime(localTime);
+}
+
+// the detector task sleeps while not measuring
+void wakeDetector() {
+    if (readDetectorTaskHandle != NULL) {
+        xTaskNotifyGive(readDetectorTaskHandle);
+    }
+}
+
+void startMeasurement() {
+    detector.startMeasurement();
+    wakeDetector();
 }
 
 void addSendQueue(Message message) {
+    tracer.mark(message, TRACE_SEND_QUEUED);
     if (xQueueSend(sendQueue, &message, 0) != pdTRUE) {
-        Log.errorln("Problem while putting a message to a send queue, is it full?");
+        linkBenchmark.onQueueOverflow();
+        DLog.errorln("Problem while putting a message to a send queue, is it full?");
     }
 }
 
 void addStateMachineQueue(Message message) {
+    tracer.mark(message, TRACE_QUEUED);
     if (xQueueSend(stateMachineEventQueue, &message, 0) != pdTRUE) {
-        Log.errorln("Problem while putting a message to a state machine queue, is it full?");
+        linkBenchmark.onQueueOverflow();
+        DLog.errorln("Problem while putting a message to a state machine queue, is it full?");
+    }
+}
+
+/**
+ * Benchmark frames are answered by both state machines regardless of the state,
+ * so the round trip includes both state machine queues.
+ *
+ * @return true when the message was a benchmark one
+ */
+bool handleBenchmarkMessage(Message message) {
+    if (message.event == EVENT_BENCH_PING) {
+        message.event = EVENT_BENCH_PONG;
+        addSendQueue(message);  // back to the source peer
+        return true;
+    }
+    if (message.event == EVENT_BENCH_PONG) {
+        linkBenchmark.onPong(nowMicros() - message.time);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Stops the raw sample recording, the run gets persisted in the background if enabled.
+ */
+void finishTraceRecording() {
+    if (recorder.isRecording()) {
+        recorder.stopRun();
+        if (recorder.isPersistent()) {
+            scheduler.trigger(persistTraceJobId);
+        }
     }
 }
 
 // Callback when data is sent
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
+    tracer.onSendDone();
     if (status == ESP_NOW_SEND_FAIL) {
-        if (currentState != STATE_START) {
-            Message message;
-            message.event = EVENT_SEND_ERROR;
-            addStateMachineQueue(message);
-        }
+        linkBenchmark.onSendFailure();  // lost reliable frames are retransmitted by the link
     }
 }
 
+// reliable message given up by the link, a missing split gate does not spoil the run
+void onLinkFailure(Message &message) {
+    if (currentState() != STATE_START && peers.get(message.peer).role != ROLE_SPLIT) {
+        Message error;
+        error.event = EVENT_SEND_ERROR;
+        addStateMachineQueue(error);
+    }
+}
+
+// WiFi task - stamp, validate, copy to the ring and wake the receive task, nothing else
 void OnDataRecv(const uint8_t *mac, const uint8_t *incomingData, int len) {
+    int64_t arrivalTime = nowMicros();
+    receiveRing.push(mac, incomingData, len, sizeof(FrameHeader), arrivalTime);
+}
+
+void handleFrame(const ReceivedFrame &frame) {
+    int64_t receiveTime = frame.arrivalTime;
     Message message;
-    memcpy(&message, incomingData, sizeof(message));
-    Log.infoln("Received message event %s (%d)", eventName(message.event), message.time);
+    if (!link.receive(frame.address, frame.data, frame.length, message)) {
+        return;
+    }
+    if (message.event == EVENT_ANNOUNCE) {
+        if (peers.offer(frame.address, message.role, message.gate)) {
+            scheduler.trigger(discoveryJobId);
+        }
+        return;
+    }
+    // clock synchronization is answered right here, the state machine would only add latency
+    if (message.event == EVENT_SYNC_PING) {
+        Message pong;
+        pong.event = EVENT_SYNC_PONG;
+        pong.peer = message.peer;
+        pong.time = message.sendTime;
+        pong.receiveTime = receiveTime;
+        addSendQueue(pong);
+        return;
+    }
+    if (message.event == EVENT_SYNC_PONG) {
+        clockSync.addSample(message.time, message.receiveTime, message.sendTime, receiveTime);
+        return;
+    }
+    tracer.mark(message, TRACE_RECEIVED, receiveTime);
+    DLog.infoln("Received message event %s (%l us)", eventName(message.event), (long)message.time);
     addStateMachineQueue(message);
 }
 
-void readResetButtonTask(void *pvParameters) {
-    while (1) {
-        vTaskDelay(50 / portTICK_PERIOD_MS);
-        bounce.update();
-        if (bounce.changed()) {
-            int deboucedInput = bounce.read();
-            if (deboucedInput == HIGH) {
-                Message message;
-                message.event = EVENT_BUTTON_RESET;
-                addStateMachineQueue(message);
-                addSendQueue(message);
-            }
+// Housekeeping jobs, run by the scheduler task, return the delay until the next run [us]
+
+int64_t readResetButtonJob() {
+    bounce.update();
+    if (bounce.changed()) {
+        int deboucedInput = bounce.read();
+        if (deboucedInput == HIGH) {
+            Message message;
+            message.event = EVENT_BUTTON_RESET;
+            addStateMachineQueue(message);
+            addSendQueue(message);
         }
     }
+    return 50 * MICROS_PER_MILLI;
 }
 
-void updateRgbLedTask(void *pvParameters) {
-    while (1) {
-        rgbLed.update();
-        vTaskDelay(50 / portTICK_PERIOD_MS);
+int64_t updateRgbLedJob() {
+    rgbLed.update();
+    return 50 * MICROS_PER_MILLI;
+}
+
+// filtered sample every second, the LED follows once a minute (first after the filter settled)
+int64_t updateBatteryJob() {
+    static uint8_t samples = 55;
+    battery.update();
+    if (++samples < 60) {
+        return 1000 * MICROS_PER_MILLI;
+    }
+    samples = 0;
+
+    int prct = battery.getPercentage();
+    DLog.infoln("Battery %d mV, %d prct, runtime %l s", battery.getVoltage(), prct, (long)battery.getRemainingRuntime());
+    if (prct < 10) {
+        DLog.infoln("Battery REDb");
+        rgbLed.setBlinkingColor(CRGB::Red, 20);
+    } else if (prct < 20) {
+        DLog.infoln("Battery RED");
+        rgbLed.setSolidColor(CRGB::Red, 20);
+    } else if (prct < 40) {
+        DLog.infoln("Battery YELLOW");
+        rgbLed.setSolidColor(CRGB::Yellow, 20);
+    } else if (prct < 60) {
+        DLog.infoln("Battery GreenYellow");
+        rgbLed.setSolidColor(CRGB::GreenYellow, 20);
+    } else {
+        DLog.infoln("Battery GREEN");
+        rgbLed.setSolidColor(CRGB::Green, 20);
     }
+    return 1000 * MICROS_PER_MILLI;
 }
 
-void updateBatteryTask(void *pvParameters) {
-    while (1) {
-        battery.update();
-        int prct = battery.getPercentage();
-        for (int i = 0; i < 4; i++) {
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            battery.update();
-            prct = max(prct, battery.getPercentage());
-        }
+int64_t updateDisplayJob() {
+    int64_t delay = display.update();
+    tracer.onRendered();
+    return delay;
+}
 
-        Log.infoln("Battery value %d prct", prct);
-        if (prct < 10) {
-            Log.infoln("Battery REDb");
-            rgbLed.setBlinkingColor(CRGB::Red, 20);
-        } else if (prct < 20) {
-            Log.infoln("Battery RED");
-            rgbLed.setSolidColor(CRGB::Red, 20);
-        } else if (prct < 40) {
-            Log.infoln("Battery YELLOW");
-            rgbLed.setSolidColor(CRGB::Yellow, 20);
-        } else if (prct < 60) {
-            Log.infoln("Battery GreenYellow");
-            rgbLed.setSolidColor(CRGB::GreenYellow, 20);
-        } else {
-            Log.infoln("Battery GREEN");
-            rgbLed.setSolidColor(CRGB::Green, 20);
-        }
-        vTaskDelay(1000 * 60 / portTICK_PERIOD_MS);
+void onDisplayChanged() {
+    scheduler.trigger(displayJobId);
+}
+
+// full speed and the radio always on from READY until the run is over, power saving otherwise,
+// the detector samples at the fastest rate where a crossing is expected and learns the empty scene
+// while waiting for it
+void onStateChanged(uint8_t state) {
+    power.onStateChange(state);
+    power.setTimingCritical(state == STATE_READY || state == STATE_RUN_CHECK || state == STATE_RUN);
+    sampling.setCritical(isStartDevice() ? state == STATE_READY || state == STATE_RUN_CHECK : state == STATE_RUN);
+    detector.setLearning(isStartDevice() ? state == STATE_READY : state == STATE_RUN);
+}
+
+const char *powerStateName(uint8_t state) {
+    return stateName((State)state);
+}
+
+// Start device actions
+
+void enterStartState() {
+    detector.stopMeasurement();
+    runs.clear();
+}
+
+void enterReadyState() {
+    if (runs.count() == 0) {
+        display.showZeroTime();  // otherwise the runs on course keep running on the display
     }
 }
 
-void updateDisplay(void *pvParameters) {
-    while (1) {
-        display.update();
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+void enterFinishState() {
+    finishTraceRecording();
+}
+
+int64_t runConfirmationDeadline() {
+    return startTime + RUN_CONFIRMATION_TIME;
+}
+
+int64_t finishTimeoutDeadline() {
+    return nowMicros() + FINISH_TIMEOUT;
+}
+
+void resetAction(Message &message) {
+    display.showConnecting();
+    finishTraceRecording();
+    if (isStartDevice() && message.peer < PEERS_MAX) {
+        Message reset;  // reset from a gate, pass it to the other gates
+        reset.event = EVENT_BUTTON_RESET;
+        addSendQueue(reset);
     }
 }
 
-void stateMachineStartDeviceTask(void *pvParameters) {
-    Message message;
-    while (1) {
-        if (xQueueReceive(stateMachineEventQueue, (void *)&message, 10000) == pdTRUE) {
-            Log.infoln("SM: state %s, event %s", stateName(currentState), eventName(message.event));
-            if (message.event == EVENT_BUTTON_RESET) {
-                currentState = STATE_START;
-                display.showConnecting();
-                detector.stopMeasurement();
-                continue;
-            }
-            if (message.event == EVENT_SEND_ERROR) {
-                display.showError();
-                detector.stopMeasurement();
-                continue;
-            }
-            switch (currentState) {
-                case STATE_START:
-                    detector.stopMeasurement();
-                    if (message.event == EVENT_MESSAGE_ACK) {
-                        detector.startMeasurement();
-                        display.showZeroTime();
-                        currentState = STATE_READY;
-                        stateChangeTime = millis();
-                    }
-                    break;
-                case STATE_READY:
-                    if (message.event == EVENT_DETECTOR_OBJECT_LEFT) {
-                        currentState = STATE_RUN_CHECK;
-                        stateChangeTime = millis();
-                        startTime = millis() - message.time;        //we have started message.time ago
-                        display.showTimeContinuously(message.time); //show correct time starting with message.time
-                    }
-                    break;
-                case STATE_RUN_CHECK:
-                    if (message.event == EVENT_DETECTOR_OBJECT_ARRIVED) {
-                        currentState = STATE_READY;
-                    } else if (message.event == EVENT_RUN_CONFIRMED) {
-                        currentState = STATE_RUN;
-                        stateChangeTime = millis();
-                        detector.stopMeasurement();
-                        message.time = millis() - startTime;
-                        addSendQueue(message);                        
-                    }
-                    break;
-                case STATE_RUN:
-                    if (message.event == EVENT_DETECTOR_OBJECT_ARRIVED) {
-                        measuredTime = millis() - startTime - message.time; //current time - start time - detector compensation time
-                        display.showTime(measuredTime);
-                        message.event = EVENT_MESSAGE_FINISH;
-                        message.time = measuredTime;
-                        currentState = STATE_FINISH;
-                        stateChangeTime = millis();
-                        addSendQueue(message);
-                    }
-                    break;
-                case STATE_FINISH:
-                    if (message.event == EVENT_TIMEOUT) {
-                        currentState = STATE_START;
-                        stateChangeTime = millis();
-                    }
-                    break;
-                default:
-                    break;
-            }
-            Log.infoln("SM: new state %s", stateName(currentState));
-        }
+void sendErrorAction(Message &message) {
+    display.showError();
+    detector.stopMeasurement();
+    finishTraceRecording();
+}
+
+void startReadyAction(Message &message) {
+    startMeasurement();
+    recorder.startRun(nowMicros());
+}
+
+void startRunCheckAction(Message &message) {
+    startTime = message.time;  //crossing timestamp from the detector
+    if (runs.count() == 0) {
+        display.showTimeContinuously(nowMicros() - startTime);  //show correct time starting with the crossing
+        tracer.mark(message, TRACE_DISPLAY);
+    }
+    if (!recorder.isRecording()) {
+        recorder.startRun(startTime);  // pipeline mode, the recording stopped with the last run on course
     }
 }
 
-void stateMachineFinishDeviceTask(void *pvParameters) {
+void startRunAction(Message &message) {
+    if (!pipelineMode) {
+        detector.stopMeasurement();
+    }
+    Run *run = runs.push(++lastRunId, startTime);
+    message.run = run->id;
+    message.time = startTime;
+    addSendQueue(message);
+}
+
+bool isPipelineMode(Message &message) {
+    return pipelineMode;
+}
+
+bool isFromFinish(Message &message) {
+    return message.peer < PEERS_MAX && message.role == ROLE_FINISH && runs.count() > 0;
+}
+
+bool isFromSplit(Message &message) {
+    return message.peer < PEERS_MAX && message.role == ROLE_SPLIT && runs.findForGate(message.gate) != NULL;
+}
+
+bool isLocal(Message &message) {
+    return message.peer >= PEERS_MAX;
+}
+
+bool isFinishReady(Message &message) {
+    return message.peer < PEERS_MAX && message.role == ROLE_FINISH;
+}
+
+void startSplitAction(Message &message) {
+    Run *run = runs.findForGate(message.gate);
+    int64_t split = message.time - run->startTime;
+    int64_t lap = message.time - run->lastCrossingTime;
+    run->lastCrossingTime = message.time;
+    run->gate = message.gate;
+    if (message.gate <= RUN_GATES) {
+        run->splits[message.gate - 1] = split;
+    }
+    DLog.infoln("Run %u split %u: %u ms, lap %u ms", run->id, message.gate, (uint32_t)(split / 1000), (uint32_t)(lap / 1000));
+}
+
+// written by the journal task, the flash write never delays the state machine or the display
+void storeResult(Run *run, int64_t time) {
+    JournalRecord record = {};
+    record.run = run->id;
+    record.startTime = run->startTime;
+    record.time = time;
+    for (uint8_t i = 0; i < RUN_GATES && i < JOURNAL_SPLITS; i++) {
+        record.splits[i] = run->splits[i];
+    }
+    record.flags = pipelineMode ? JOURNAL_FLAG_PIPELINE : 0;
+    journal.submit(record);
+}
+
+// the finish crossing belongs to the oldest run on course
+void startFinishAction(Message &message) {
+    Run *run = runs.front();
+    measuredTime = message.time - run->startTime;  //finish crossing timestamp - start crossing timestamp
+    display.showTime(measuredTime);
+    tracer.mark(message, TRACE_DISPLAY);
+    DLog.infoln("Run %u finish: %u ms, lap %u ms", run->id, (uint32_t)(measuredTime / 1000), (uint32_t)((message.time - run->lastCrossingTime) / 1000));
+    storeResult(run, measuredTime);
+    message.event = EVENT_MESSAGE_FINISH;
+    message.run = run->id;
+    message.time = measuredTime;
+    message.peer = PEER_DEFAULT;
+    addSendQueue(message);
+    runs.pop();
+    if (runs.count() == 0) {
+        finishTraceRecording();  // STATE_FINISH is not entered in pipeline mode
+    }
+}
+
+const StateDefinition startDeviceStates[] = {
+    // state, entry, exit, deadline event, deadline
+    {STATE_START, enterStartState, NULL, EVENT_TIMEOUT, NULL},
+    {STATE_READY, enterReadyState, NULL, EVENT_TIMEOUT, NULL},
+    {STATE_RUN_CHECK, NULL, NULL, EVENT_RUN_CONFIRMED, runConfirmationDeadline},
+    {STATE_FINISH, enterFinishState, NULL, EVENT_TIMEOUT, finishTimeoutDeadline},
+};
+
+const Transition startDeviceTransitions[] = {
+    // state, event, guard, action, next state
+    {STATE_ANY, EVENT_BUTTON_RESET, NULL, resetAction, STATE_START},
+    {STATE_ANY, EVENT_SEND_ERROR, NULL, sendErrorAction, STATE_SAME},
+    {STATE_ANY, EVENT_DETECTOR_OBJECT_ARRIVED, isFromSplit, startSplitAction, STATE_SAME},
+    {STATE_START, EVENT_MESSAGE_ACK, isFinishReady, startReadyAction, STATE_READY},
+    {STATE_READY, EVENT_DETECTOR_OBJECT_LEFT, NULL, startRunCheckAction, STATE_RUN_CHECK},
+    {STATE_RUN_CHECK, EVENT_DETECTOR_OBJECT_ARRIVED, isLocal, NULL, STATE_READY},
+    {STATE_RUN_CHECK, EVENT_RUN_CONFIRMED, isPipelineMode, startRunAction, STATE_READY},
+    {STATE_RUN_CHECK, EVENT_RUN_CONFIRMED, NULL, startRunAction, STATE_RUN},
+    {STATE_RUN, EVENT_DETECTOR_OBJECT_ARRIVED, isFromFinish, startFinishAction, STATE_FINISH},
+    {STATE_READY, EVENT_DETECTOR_OBJECT_ARRIVED, isFromFinish, startFinishAction, STATE_SAME},     // pipeline mode
+    {STATE_RUN_CHECK, EVENT_DETECTOR_OBJECT_ARRIVED, isFromFinish, startFinishAction, STATE_SAME},  // pipeline mode
+    {STATE_FINISH, EVENT_TIMEOUT, NULL, NULL, STATE_START},
+};
+
+// Finish and split gate actions
+
+bool isClockSynchronized(Message &message) {
+    return clockSync.isSynchronized();  // absolute timestamps are useless until the clocks are synchronized
+}
+
+void finishReadyAction(Message &message) {
+    Message ack;
+    ack.event = EVENT_MESSAGE_ACK;
+    addSendQueue(ack);
+    recorder.startRun(nowMicros());
+}
+
+void finishRunAction(Message &message) {
+    startMeasurement();
+    startTime = clockSync.toLocalTime(message.time);
+    runs.push(message.run, startTime);
+    if (runs.count() == 1) {
+        display.showTimeContinuously(nowMicros() - startTime);
+    }
+}
+
+// keeps measuring while other runs are on course, they are matched to the crossings by the start device
+void finishArrivedAction(Message &message) {
+    if (runs.count() <= 1) {
+        detector.stopMeasurement();
+    }
+    if (peers.getRole() == ROLE_SPLIT && runs.front() != NULL) {
+        display.showTime(message.time - runs.front()->startTime);  // split until the final time comes
+        tracer.mark(message, TRACE_DISPLAY);
+    }
+}
+
+bool isLastRun(Message &message) {
+    return runs.count() <= 1;
+}
+
+void finishFinishAction(Message &message) {
+    measuredTime = message.time;
+    display.showTime(measuredTime);
+    tracer.mark(message, TRACE_DISPLAY);
+    runs.remove(message.run);
+}
+
+const StateDefinition finishDeviceStates[] = {
+    // state, entry, exit, deadline event, deadline
+    {STATE_START, enterStartState, NULL, EVENT_TIMEOUT, NULL},
+    {STATE_READY, enterReadyState, NULL, EVENT_TIMEOUT, NULL},
+    {STATE_FINISH, enterFinishState, NULL, EVENT_TIMEOUT, finishTimeoutDeadline},
+};
+
+const Transition finishDeviceTransitions[] = {
+    // state, event, guard, action, next state
+    {STATE_ANY, EVENT_BUTTON_RESET, NULL, resetAction, STATE_START},
+    {STATE_START, EVENT_MESSAGE_INIT, isClockSynchronized, finishReadyAction, STATE_READY},
+    {STATE_READY, EVENT_RUN_CONFIRMED, NULL, finishRunAction, STATE_RUN},
+    {STATE_RUN, EVENT_RUN_CONFIRMED, NULL, finishRunAction, STATE_SAME},  // pipeline mode
+    {STATE_RUN, EVENT_DETECTOR_OBJECT_ARRIVED, NULL, finishArrivedAction, STATE_SAME},
+    {STATE_RUN, EVENT_MESSAGE_FINISH, isLastRun, finishFinishAction, STATE_FINISH},
+    {STATE_RUN, EVENT_MESSAGE_FINISH, NULL, finishFinishAction, STATE_SAME},
+    {STATE_FINISH, EVENT_TIMEOUT, NULL, NULL, STATE_START},
+};
+
+void stateMachineTask(void *pvParameters) {
     Message message;
     while (1) {
-        if (xQueueReceive(stateMachineEventQueue, (void *)&message, 10000) == pdTRUE) {
-            Log.infoln("SM: state %s, event %s", stateName(currentState), eventName(message.event));
-            if (message.event == EVENT_BUTTON_RESET) {
-                currentState = STATE_START;
-                detector.stopMeasurement();
-                display.showConnecting();
+        if (xQueueReceive(stateMachineEventQueue, (void *)&message, portMAX_DELAY) == pdTRUE) {
+            tracer.mark(message, TRACE_DISPATCHED);
+            if (handleBenchmarkMessage(message)) {
                 continue;
             }
-            switch (currentState) {
-                case STATE_START:
-                    detector.stopMeasurement();
-                    if (message.event == EVENT_MESSAGE_INIT) {
-                        Message message;
-                        message.event = EVENT_MESSAGE_ACK;
-                        addSendQueue(message);
-                        display.showZeroTime();
-                        currentState = STATE_READY;
-                        stateChangeTime = millis();
-                    }
-                    break;
-                case STATE_READY:
-                    display.showZeroTime();
-                    if (message.event == EVENT_RUN_CONFIRMED) {
-                        display.showTimeContinuously(message.time);
-                        detector.startMeasurement();
-                        currentState = STATE_RUN;
-                        stateChangeTime = millis();
-                        startTime = message.time;
-                    }
-                    break;
-                case STATE_RUN:
-                    if (message.event == EVENT_DETECTOR_OBJECT_ARRIVED) {
-                        detector.stopMeasurement();                       
-                    } else if (message.event == EVENT_MESSAGE_FINISH) {
-                        measuredTime = message.time;
-                        display.showTime(measuredTime);
-                        currentState = STATE_FINISH;
-                        stateChangeTime = millis();
-                    }
-                    break;
-                case STATE_FINISH:
-                    if (message.event == EVENT_TIMEOUT) {
-                        currentState = STATE_START;
-                        stateChangeTime = millis();
-                    }
-                    break;
-                default:
-                    break;
+            DLog.infoln("SM: state %s, event %s", stateName(currentState()), eventName(message.event));
+            if (stateMachine.dispatch(message)) {
+                DLog.infoln("SM: new state %s", stateName(currentState()));
             }
-            Log.infoln("SM: new state %s", stateName(currentState));
         }
     }
 }
 
-void stateMachineTask(void *pvParameters) {
-    if (isStartDevice()) {
-        stateMachineStartDeviceTask(pvParameters);
-    } else {
-        stateMachineFinishDeviceTask(pvParameters);
-    }
+// the crossing starts its latency trace, the stages are measured from the crossing time
+void traceCrossing(Message &message, TracePath path, int64_t detectedTime) {
+    message.trace = tracer.begin(path);
+    message.traceOrigin = toStartDeviceTime(detector.getCrossingTime());
+    tracer.mark(message, TRACE_ECHO, detector.getSampleTime() + detector.getEchoDuration());
+    tracer.mark(message, TRACE_DETECTED, detectedTime);
 }
 
+// initializes the detector itself, the echo ISR gets attached on the sampling core
 void readDetectorTask(void *pvParameters) {
+    detector.init();
     while (1) {
         DetectedObjectState detectedObjectState = detector.read();
+        int64_t detectedTime = nowMicros();
+        if (jitterBenchmark.isRunning()) {
+            if (!detector.isMeasurementEnabled()) {
+                detector.probe();
+            }
+            if (jitterBenchmark.onSample(detector.getTriggerTime(), detector.getSampleTime(), detector.getEchoDuration())) {
+                scheduler.trigger(jitterBenchmarkJobId);
+            }
+        }
+        if (detector.isMeasurementEnabled()) {
+            // one sample per sensor, the last one of the round carries the decision
+            for (uint8_t i = 0; i < detector.getRoundSize(); i++) {
+                const DetectorSample &sample = detector.getRoundSample(i);
+                uint8_t state = (i == detector.getRoundSize() - 1 ? detectedObjectState : NONE) |
+                                (detector.isObjectDetected() ? RECORDER_STATE_OBJECT_DETECTED : 0) |
+                                (sample.sensor << RECORDER_STATE_SENSOR_SHIFT);
+                recorder.record(sample.time, sample.echoDuration, state);
+            }
+        }
         if (detectedObjectState == ARRIVED) {
             Message message;
             message.event = EVENT_DETECTOR_OBJECT_ARRIVED;
-            message.time = detector.getCompensationTime();
-            Log.info("Compensation time (arrived) %d", detector.getCompensationTime());
-            addSendQueue(message);
+            message.time = toStartDeviceTime(detector.getCrossingTime());
+            traceCrossing(message, TRACE_PATH_FINISH_CROSSING, detectedTime);
+            if (!isStartDevice()) {
+                addSendQueue(message);  // gates report their crossings to the start device
+            }
+            message.time = detector.getCrossingTime();
             addStateMachineQueue(message);
-            Log.infoln("Object arrived");
+            DLog.infoln("Object arrived, compensation time %l us", (long)detector.getCompensationTime());
         } else if (detectedObjectState == LEFT) {
             Message message;
             message.event = EVENT_DETECTOR_OBJECT_LEFT;
-            message.time = detector.getCompensationTime();            
-            Log.info("Compensation time (arrived) %d", detector.getCompensationTime());
+            message.time = detector.getCrossingTime();
+            traceCrossing(message, TRACE_PATH_START_CROSSING, detectedTime);
             addStateMachineQueue(message);
-            Log.infoln("Object left");
+            DLog.infoln("Object left, compensation time %l us", (long)detector.getCompensationTime());
+        }
+        int64_t delay = sampling.next(detector.isMeasurementEnabled(), detector, nowMicros());
+        if (jitterBenchmark.isRunning()) {
+            delay = SAMPLING_FAST_PERIOD;  // the benchmark measures the fastest cadence
+        }
+        if (delay == SAMPLING_IDLE) {
+            ulTaskNotifyTake(pdTRUE, SAMPLING_IDLE_PERIOD / portTICK_PERIOD_MS);
+        } else {
+            vTaskDelay((delay + portTICK_PERIOD_MS * MICROS_PER_MILLI - 1) / (portTICK_PERIOD_MS * MICROS_PER_MILLI));
         }
-        vTaskDelay(5 / portTICK_PERIOD_MS);
     }
 }
 
-void establishCommunicationTask(void *pvParameters) {
+// decodes the received frames in place, acknowledges them and feeds the state machine
+void receiveTask(void *pvParameters) {
     while (1) {
-        if (isStartDevice() && currentState == STATE_START) {
-            Message message;
-            message.event = EVENT_MESSAGE_INIT;
-            Log.infoln("Establishing communication...");
-            addSendQueue(message);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        const ReceivedFrame *frame;
+        while ((frame = receiveRing.peek()) != NULL) {
+            handleFrame(*frame);
+            receiveRing.release();
         }
-        vTaskDelay(300 / portTICK_PERIOD_MS);
     }
 }
 
+// READY too, split gates may join late
+int64_t establishCommunicationJob() {
+    if (currentState() == STATE_START || currentState() == STATE_READY) {
+        Message message;
+        message.event = EVENT_MESSAGE_INIT;
+        DLog.infoln("Establishing communication...");
+        addSendQueue(message);
+    }
+    return 300 * MICROS_PER_MILLI;
+}
+
+// sends the queued messages, sleeps until the next retransmission of the unacknowledged ones
 void communicationTask(void *pvParameters) {
     Message message;
     while (1) {
-        if (xQueueReceive(sendQueue, (void *)&message, 10000) == pdTRUE) {
-            Log.infoln("Sending message %s (%d) from %s", eventName(message.event), message.time, WiFi.macAddress().c_str());
-            uint8_t *address = startDeviceAddress;
-            esp_err_t result = esp_now_send(peerInfo.peer_addr, (uint8_t *)&message, sizeof(message));
-            if (result != ESP_OK) {
-                Log.errorln("Error sending the data");
-            }
+        int64_t delay = link.retransmit();
+        TickType_t ticks = delay == LINK_IDLE ? portMAX_DELAY : delay / (portTICK_PERIOD_MS * MICROS_PER_MILLI) + 1;
+        if (xQueueReceive(sendQueue, (void *)&message, ticks) == pdTRUE) {
+            DLog.infoln("Sending message %s (%l us) to %d", eventName(message.event), (long)message.time, message.peer);
+            link.send(message);
         }
     }
 }
 
-void additionalDelayedTask(void *pvParameters) {
-    while (1) {
-        if (isStartDevice() && currentState == STATE_RUN_CHECK && ((millis() - startTime) >= 100)) {
-            Message message;
-            message.event = EVENT_RUN_CONFIRMED;
-            addStateMachineQueue(message);
-        } else if (currentState == STATE_FINISH && ((millis() - stateChangeTime) > 8000)) {
-            Message message;
-            message.event = EVENT_TIMEOUT;
-            addStateMachineQueue(message);
+// announces the device while not running, stores the peers announced by the others
+int64_t discoveryJob() {
+    peers.commit();
+    if (currentState() == STATE_START || currentState() == STATE_READY) {
+        Message message;
+        message.event = EVENT_ANNOUNCE;
+        message.peer = PEER_BROADCAST;
+        addSendQueue(message);
+    }
+    return PEERS_DISCOVERY * MICROS_PER_MILLI;
+}
+
+int64_t synchronizeClockJob() {
+    Message message;
+    message.event = EVENT_SYNC_PING;
+    addSendQueue(message);
+    return CLOCK_SYNC_PERIOD * MICROS_PER_MILLI;
+}
+
+int64_t persistTraceJob() {
+    recorder.persist();
+    return SCHEDULER_IDLE;
+}
+
+int64_t linkBenchmarkJob() {
+    static bool draining = false;
+    if (linkBenchmark.isPingDue()) {
+        Message message;
+        message.event = EVENT_BENCH_PING;
+        message.peer = 0;  // first peer only, the start device would ping all of them
+        message.time = nowMicros();
+        message.size = linkBenchmark.getSize();
+        addSendQueue(message);
+        linkBenchmark.onPingSent();
+        return 1000000 / linkBenchmark.getRate();
+    }
+    if (linkBenchmark.isRunning() && !draining) {
+        draining = true;
+        return BENCHMARK_DRAIN_TIME * MICROS_PER_MILLI;
+    }
+    if (linkBenchmark.isRunning()) {
+        linkBenchmark.finish(&Console);
+    }
+    draining = false;
+    return SCHEDULER_IDLE;
+}
+
+int64_t jitterBenchmarkJob() {
+    jitterBenchmark.finish(&Console);
+    return SCHEDULER_IDLE;
+}
+
+/**
+ * Serial commands:
+ *   bench [rate [size [count]]] - link round trip benchmark
+ *   jitter [samples [load_prct [core]]] - sample period and echo timing under synthetic load, see jitter.h
+ *   link - retransmission statistics
+ *   detector window arrive_cm leave_cm [median [max_timeouts]] - detection stage configuration
+ *   sampling - current detector cadence and rounds taken per cadence, see sampling.h
+ *   background [reset] - learned empty scene per sensor, see background.h
+ *   trace persist on|off - store every run to flash
+ *   trace dump|stored [baud] - the last run / all stored runs, same as export last|traces
+ *   battery - voltage, charge and remaining runtime
+ *   power - modelled average current per state
+ *   latency [reset] - per-stage latency of the crossings since the crossing time, see tracer.h
+ *   memory - stack high-water marks of the tasks, queue usage and heap, see memory.h
+ *   role start|finish|split gate - stores the device role and restarts
+ *   peers [clear] - known peers, clear forgets them and restarts
+ *   pipeline on|off - start the next run while the previous ones are on course (start device)
+ *   results [count] - the newest results from the journal (start device)
+ *   export results|traces|last|all [baud] - framed binary export, see exporter.h and tools/export_decode.py
+ */
+int64_t readSerialCommandJob() {
+    static char line[64];
+    static uint8_t length = 0;
+    while (Serial.available()) {
+        char c = Serial.read();
+        if (c != '\n' && c != '\r' && length < sizeof(line) - 1) {
+            line[length++] = c;
+            continue;
+        }
+        line[length] = 0;
+        length = 0;
+        if (strncmp(line, "bench", 5) == 0) {
+            unsigned rate = BENCHMARK_DEFAULT_RATE, size = BENCHMARK_DEFAULT_SIZE, count = BENCHMARK_DEFAULT_COUNT;
+            sscanf(line + 5, "%u %u %u", &rate, &size, &count);
+            linkBenchmark.start(rate, size, count);
+            scheduler.trigger(linkBenchmarkJobId);
+        } else if (strncmp(line, "jitter", 6) == 0) {
+            unsigned samples = JITTER_DEFAULT_SAMPLES, load = JITTER_DEFAULT_LOAD, core = SYSTEM_CORE;
+            sscanf(line + 6, "%u %u %u", &samples, &load, &core);
+            jitterBenchmark.start(samples, load, core % portNUM_PROCESSORS);
+            wakeDetector();
+        } else if (strncmp(line, "link", 4) == 0) {
+            link.printStatistics(&Console);
+            receiveRing.printStatistics(&Console);
+        } else if (strncmp(line, "detector", 8) == 0) {
+            DetectorConfig config = detector.getConfig();
+            unsigned window = config.windowSize, median = config.medianFilter, timeouts = config.maxTimeouts;
+            if (sscanf(line + 8, "%u %f %f %u %u", &window, &config.arriveThreshold, &config.leaveThreshold, &median, &timeouts) >= 3) {
+                config.windowSize = window;
+                config.medianFilter = median != 0;
+                config.maxTimeouts = timeouts;
+                detector.setConfig(config);
+            }
+            config = detector.getConfig();
+            Console.printf("Detector: window %u, arrive %.0f cm, leave %.0f cm, median %u, max timeouts %u\r\n", config.windowSize,
+                          config.arriveThreshold, config.leaveThreshold, config.medianFilter, config.maxTimeouts);
+        } else if (strncmp(line, "background", 10) == 0) {
+            if (strstr(line + 10, "reset") != NULL) {
+                detector.resetBackground();
+            }
+            for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+                BackgroundModel background = detector.getBackground(i);
+                Console.printf("Background %u: %u samples, mean %.1f cm, deviation %.1f cm, timeouts %.0f %%, ", i, background.getCount(),
+                              background.getMean(), background.getDeviation(), background.getTimeoutRate() * 100);
+                if (!background.isReady()) {
+                    Console.printf("learning\r\n");
+                } else if (!background.hasSurface()) {
+                    Console.printf("open field, configured threshold\r\n");
+                } else {
+                    Console.printf("arrive below %.1f cm\r\n", background.getArriveThreshold());
+                }
+            }
+        } else if (strncmp(line, "sampling", 8) == 0) {
+            sampling.printStatistics(&Console);
+        } else if (strncmp(line, "trace persist", 13) == 0) {
+            recorder.setPersistent(strstr(line + 13, "on") != NULL);
+            Console.printf("Trace persist %s\r\n", recorder.isPersistent() ? "on" : "off");
+        } else if (strncmp(line, "trace dump", 10) == 0 || strncmp(line, "trace stored", 12) == 0) {
+            bool stored = strncmp(line, "trace stored", 12) == 0;
+            unsigned baud = EXPORT_BAUD;
+            sscanf(line + (stored ? 12 : 10), "%u", &baud);
+            if (!exporter.start(stored ? EXPORT_TRACES : EXPORT_LAST_TRACE, baud)) {
+                Console.printf("Export running\r\n");
+            }
+        } else if (strncmp(line, "battery", 7) == 0) {
+            int32_t runtime = battery.getRemainingRuntime();
+            Console.printf("Battery: %u mV, %u.%u %%, ", battery.getVoltage(), battery.getLevel() / 10, battery.getLevel() % 10);
+            if (runtime == BATTERY_RUNTIME_UNKNOWN) {
+                Console.printf("runtime unknown yet\r\n");
+            } else {
+                Console.printf("runtime %d h %02d min\r\n", (int)(runtime / 3600), (int)(runtime / 60 % 60));
+            }
+        } else if (strncmp(line, "role", 4) == 0) {
+            unsigned gate = 0;
+            char role[8] = "";
+            sscanf(line + 4, "%7s %u", role, &gate);
+            if (strcmp(role, "start") == 0) {
+                peers.setRole(ROLE_START, 0);
+                ESP.restart();
+            } else if (strcmp(role, "finish") == 0) {
+                peers.setRole(ROLE_FINISH, 0);
+                ESP.restart();
+            } else if (strcmp(role, "split") == 0 && gate > 0) {
+                peers.setRole(ROLE_SPLIT, gate);
+                ESP.restart();
+            }
+            Console.printf("role start|finish|split gate\r\n");
+        } else if (strncmp(line, "peers", 5) == 0) {
+            if (strstr(line + 5, "clear") != NULL) {
+                peers.clear();
+                ESP.restart();
+            }
+            peers.print(&Console);
+        } else if (strncmp(line, "pipeline", 8) == 0) {
+            pipelineMode = strstr(line + 8, "on") != NULL;
+            Console.printf("Pipeline %s\r\n", pipelineMode ? "on" : "off");
+        } else if (strncmp(line, "results", 7) == 0) {
+            unsigned count = 10;
+            sscanf(line + 7, "%u", &count);
+            journal.print(&Console, count);
+        } else if (strncmp(line, "export", 6) == 0) {
+            char what[8] = "";
+            unsigned baud = EXPORT_BAUD;
+            sscanf(line + 6, "%7s %u", what, &baud);
+            uint8_t content = strcmp(what, "results") == 0  ? EXPORT_RESULTS
+                              : strcmp(what, "traces") == 0 ? EXPORT_TRACES
+                              : strcmp(what, "last") == 0   ? EXPORT_LAST_TRACE
+                                                            : EXPORT_RESULTS | EXPORT_TRACES | EXPORT_LAST_TRACE;
+            if (!exporter.start(content, baud)) {
+                Console.printf("Export running\r\n");
+            }
+        } else if (strncmp(line, "power", 5) == 0) {
+            power.report(&Console, powerStateName);
+        } else if (strncmp(line, "latency", 7) == 0) {
+            tracer.print(&Console);
+            if (strstr(line + 7, "reset") != NULL) {
+                tracer.reset();
+            }
+        } else if (strncmp(line, "memory", 6) == 0) {
+            memoryPlan.report(&Console);
         }
-        vTaskDelay(50 / portTICK_PERIOD_MS);
     }
+    return 100 * MICROS_PER_MILLI;
+}
+
+void schedulerTask(void *pvParameters) {
+    scheduler.run();
 }
 
 void setup() {
+    Serial.setTxBufferSize(EXPORT_TX_BUFFER);
     Serial.begin(115200);
 
     // initialize logging
     while (!Serial && !Serial.available()) {
     }
-    Log.begin(LOG_LEVEL_ERROR, &Serial);
+    Console.begin(&Serial);
+    Log.begin(LOG_LEVEL_INFO, &Console);
+    DLog.begin(LOG_LEVEL_INFO, &Console);
     Log.setPrefix(printPrefix);
     Log.setShowLevel(false);
     Log.infoln("START");
 
+    // device role
+    peers.loadRole((Role)DEVICE_TYPE);
+
     // initialize queues
-    stateMachineEventQueue = xQueueCreate(10, sizeof(Message));
-    sendQueue = xQueueCreate(10, sizeof(Message));
+    stateMachineEventQueue = memoryPlan.createQueue("State machine", STATE_MACHINE_QUEUE_LENGTH, sizeof(Message), stateMachineQueueStorage,
+                                                    &stateMachineQueueBuffer);
+    sendQueue = memoryPlan.createQueue("Send", SEND_QUEUE_LENGTH, sizeof(Message), sendQueueStorage, &sendQueueBuffer);
 
     // reset button initialization
     bounce.attach(RESET_BUTTON_PIN, INPUT_PULLUP);
@@ -407,8 +884,16 @@ void setup() {
     rgbLed.init();
     display.init();
 
-    // detector initialization
-    detector.init();
+    // battery initialization
+    battery.init();
+
+    // detector initialization (the detector task initializes the detector itself)
+    recorder.init();
+    jitterBenchmark.init(&memoryPlan);
+
+    // results journal
+    journal.init();
+    exporter.init(&Serial, &journal, &recorder);
 
     // communication initialization
     WiFi.mode(WIFI_MODE_STA);
@@ -419,42 +904,73 @@ void setup() {
     }
     Log.infoln("MAC Address: %s", WiFi.macAddress().c_str());
 
-    if (isStartDevice()) {
-        memcpy(peerInfo.peer_addr, finishDeviceAddress, 6);
-    } else {
-        memcpy(peerInfo.peer_addr, startDeviceAddress, 6);
-    }
-    peerInfo.channel = 0;
-    peerInfo.encrypt = false;
-    if (esp_now_add_peer(&peerInfo) != ESP_OK) {
-        Log.errorln("Failed to add peer");
-        return;
-    }
+    peers.init();
+    tracer.setClock(toStartDeviceTime);
+    link.init(&peers, &tracer);
+    link.setFailureCallback(onLinkFailure);
+    receiveRing.setConsumer(memoryPlan.createTask(receiveTask, "Receive", TASK_RECEIVE_STACK, NULL, TASK_RECEIVE_PRIORITY, receiveTaskStack,
+                                                  &receiveTaskBuffer, TASK_RECEIVE_CORE));
     esp_now_register_send_cb(OnDataSent);
     esp_now_register_recv_cb(OnDataRecv);
+    power.init();
 
-    xTaskCreatePinnedToCore(updateRgbLedTask, "Upd. RGB", 8000, NULL, 2, NULL, ARDUINO_RUNNING_CORE);
-    xTaskCreatePinnedToCore(updateBatteryTask, "Upd. battery", 8000, NULL, 2, NULL, ARDUINO_RUNNING_CORE);
-    xTaskCreatePinnedToCore(updateDisplay, "Upd. display", 8000, NULL, 2, NULL, ARDUINO_RUNNING_CORE);
-    xTaskCreatePinnedToCore(stateMachineTask, "State machine", 8000, NULL, 2, NULL, ARDUINO_RUNNING_CORE);
-    xTaskCreatePinnedToCore(readDetectorTask, "Read detector", 8000, NULL, 6, NULL, ARDUINO_RUNNING_CORE);
-    xTaskCreatePinnedToCore(readResetButtonTask, "Reset button", 8000, NULL, 2, NULL, ARDUINO_RUNNING_CORE);
-    xTaskCreatePinnedToCore(communicationTask, "Communication", 8000, NULL, 4, NULL, 0);
+    // start the SM
+    display.showConnecting();
     if (isStartDevice()) {
-        xTaskCreatePinnedToCore(establishCommunicationTask, "Estab. communication", 8000, NULL, 1, NULL, ARDUINO_RUNNING_CORE);
+        stateMachine.init(startDeviceStates, sizeof(startDeviceStates) / sizeof(StateDefinition), startDeviceTransitions,
+                          sizeof(startDeviceTransitions) / sizeof(Transition), stateMachineEventQueue);
+    } else {
+        stateMachine.init(finishDeviceStates, sizeof(finishDeviceStates) / sizeof(StateDefinition), finishDeviceTransitions,
+                          sizeof(finishDeviceTransitions) / sizeof(Transition), stateMachineEventQueue);
+    }
+    stateMachine.setStateChangeCallback(onStateChanged);
+    stateMachine.start(STATE_START);
+
+    // housekeeping jobs
+    displayJobId = scheduler.addJob("Upd. display", updateDisplayJob, 0);
+    display.setChangeCallback(onDisplayChanged);
+    scheduler.addJob("Upd. RGB", updateRgbLedJob, 0);
+    scheduler.addJob("Reset button", readResetButtonJob, 0);
+    scheduler.addJob("Upd. battery", updateBatteryJob, 0);
+    scheduler.addJob("Serial command", readSerialCommandJob, 0);
+    if (isStartDevice()) {
+        scheduler.addJob("Estab. communication", establishCommunicationJob, 0);
+    } else {
+        scheduler.addJob("Clock sync", synchronizeClockJob, 0);
+    }
+    discoveryJobId = scheduler.addJob("Discovery", discoveryJob, 0);
+    persistTraceJobId = scheduler.addJob("Persist trace", persistTraceJob, SCHEDULER_IDLE);
+    linkBenchmarkJobId = scheduler.addJob("Link benchmark", linkBenchmarkJob, SCHEDULER_IDLE);
+    jitterBenchmarkJobId = scheduler.addJob("Jitter benchmark", jitterBenchmarkJob, SCHEDULER_IDLE);
+
+    // core, priority and stack layout, see tasks.h
+    memoryPlan.createTask(schedulerTask, "Scheduler", TASK_SCHEDULER_STACK, NULL, TASK_SCHEDULER_PRIORITY, schedulerTaskStack, &schedulerTaskBuffer,
+                          TASK_SCHEDULER_CORE);
+    memoryPlan.createTask(stateMachineTask, "State machine", TASK_STATE_MACHINE_STACK, NULL, TASK_STATE_MACHINE_PRIORITY, stateMachineTaskStack,
+                          &stateMachineTaskBuffer, TASK_STATE_MACHINE_CORE);
+    readDetectorTaskHandle = memoryPlan.createTask(readDetectorTask, "Read detector", TASK_DETECTOR_STACK, NULL, TASK_DETECTOR_PRIORITY,
+                                                   readDetectorTaskStack, &readDetectorTaskBuffer, TASK_DETECTOR_CORE);
+    memoryPlan.createTask(communicationTask, "Communication", TASK_COMMUNICATION_STACK, NULL, TASK_COMMUNICATION_PRIORITY, communicationTaskStack,
+                          &communicationTaskBuffer, TASK_COMMUNICATION_CORE);
+    memoryPlan.createTask(Exporter::task, "Export", TASK_EXPORT_STACK, &exporter, TASK_EXPORT_PRIORITY, exportTaskStack, &exportTaskBuffer,
+                          TASK_EXPORT_CORE);
+    memoryPlan.createTask(Journal::task, "Journal", TASK_JOURNAL_STACK, &journal, TASK_JOURNAL_PRIORITY, journalTaskStack, &journalTaskBuffer,
+                          TASK_JOURNAL_CORE);
+    memoryPlan.createTask(DeferredLogging::task, "Log", TASK_LOG_STACK, NULL, TASK_LOG_PRIORITY, logTaskStack, &logTaskBuffer, TASK_LOG_CORE);
+
+    // reset button held while starting up starts the link benchmark
+    // (press it after power-on, GPIO0 held during the reset itself selects the download mode)
+    if (digitalRead(RESET_BUTTON_PIN) == LOW) {
+        linkBenchmark.start(BENCHMARK_DEFAULT_RATE, BENCHMARK_DEFAULT_SIZE, BENCHMARK_DEFAULT_COUNT);
+        scheduler.trigger(linkBenchmarkJobId);
     }
-    xTaskCreatePinnedToCore(additionalDelayedTask, "Add. delayed", 8000, NULL, 3, NULL, ARDUINO_RUNNING_CORE);
 
     // when started let's reset the peer
     Message message;
     message.event = EVENT_BUTTON_RESET;
     addSendQueue(message);
-
-    // start the SM
-    currentState = STATE_START;
-    display.showConnecting();
 }
 
 void loop() {
-    vTaskDelay(10000 / portTICK_PERIOD_MS);  // do nothing in loop
+    vTaskDelete(NULL);  // nothing runs in loop, the idle task frees the Arduino loop task stack
 }
@@ -0,0 +1,58 @@
+#include "memory.h"
+
+#include <esp_heap_caps.h>
+
+#include "logging.h"
+
+MemoryPlan::MemoryPlan() {
+    _taskCount = 0;
+    _queueCount = 0;
+}
+
+TaskHandle_t MemoryPlan::createTask(TaskFunction_t function, const char *name, uint32_t stackSize, void *parameter, UBaseType_t priority,
+                                    StackType_t *stack, StaticTask_t *buffer, BaseType_t core) {
+    TaskHandle_t handle = xTaskCreateStaticPinnedToCore(function, name, stackSize, parameter, priority, stack, buffer, core);
+    for (uint8_t i = 0; i < _taskCount; i++) {
+        if (_tasks[i].stack == stack) {
+            _tasks[i] = {name, handle, stack, stackSize, priority, core};
+            return handle;
+        }
+    }
+    if (_taskCount < MEMORY_TASKS_MAX) {
+        _tasks[_taskCount++] = {name, handle, stack, stackSize, priority, core};
+    } else {
+        DLog.errorln("Memory plan: task %s not reported", name);
+    }
+    return handle;
+}
+
+QueueHandle_t MemoryPlan::createQueue(const char *name, uint32_t length, uint32_t itemSize, uint8_t *storage, StaticQueue_t *buffer) {
+    QueueHandle_t handle = xQueueCreateStatic(length, itemSize, storage, buffer);
+    if (_queueCount < MEMORY_QUEUES_MAX) {
+        _queues[_queueCount++] = {name, handle, length, itemSize};
+    } else {
+        Log.errorln("Memory plan: queue %s not reported", name);
+    }
+    return handle;
+}
+
+void MemoryPlan::report(Print *output) {
+    uint32_t stacks = 0;
+    uint32_t queues = 0;
+    output->printf("Tasks:             core prio  stack   peak   free [B]\r\n");
+    for (uint8_t i = 0; i < _taskCount; i++) {
+        const PlannedTask &task = _tasks[i];
+        uint32_t free = uxTaskGetStackHighWaterMark(task.handle);
+        output->printf("  %-16s %4d %4u %6u %6u %6u\r\n", task.name, task.core, task.priority, task.stackSize, task.stackSize - free, free);
+        stacks += task.stackSize;
+    }
+    output->printf("Queues:            used length   item [B]\r\n");
+    for (uint8_t i = 0; i < _queueCount; i++) {
+        const PlannedQueue &queue = _queues[i];
+        output->printf("  %-16s %4u %6u %6u\r\n", queue.name, uxQueueMessagesWaiting(queue.handle), queue.length, queue.itemSize);
+        queues += queue.length * queue.itemSize;
+    }
+    output->printf("Static plan: stacks %u B, queues %u B\r\n", stacks, queues);
+    output->printf("Heap: free %u B, largest block %u B, minimum free %u B\r\n", heap_caps_get_free_size(MALLOC_CAP_8BIT),
+                   heap_caps_get_largest_free_block(MALLOC_CAP_8BIT), heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+}
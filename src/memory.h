@@ -0,0 +1,55 @@
+#ifndef memory_h
+#define memory_h
+
+#include <Arduino.h>
+
+#define MEMORY_TASKS_MAX 12
+#define MEMORY_QUEUES_MAX 4
+
+// storage of a statically created task / queue, sizes come from the plan in tasks.h
+#define STATIC_TASK(name, stackSize) \
+    static StackType_t name##Stack[stackSize]; \
+    static StaticTask_t name##Buffer
+#define STATIC_QUEUE(name, length, type) \
+    static uint8_t name##Storage[(length) * sizeof(type)]; \
+    static StaticQueue_t name##Buffer
+
+typedef struct PlannedTask {
+    const char *name;
+    TaskHandle_t handle;
+    StackType_t *stack;  // a task created again on the same stack keeps its entry
+    uint32_t stackSize;  // [B]
+    UBaseType_t priority;
+    BaseType_t core;
+} PlannedTask;
+
+typedef struct PlannedQueue {
+    const char *name;
+    QueueHandle_t handle;
+    uint32_t length;
+    uint32_t itemSize;  // [B]
+} PlannedQueue;
+
+/**
+ * Tasks and queues created from static storage (no heap, no fragmentation over a long session) and
+ * the RAM report - stack high-water marks of the planned tasks, queue usage, free and largest free
+ * heap block. Stack sizes are in bytes (StackType_t is a byte on the ESP32 port).
+ */
+class MemoryPlan {
+   public:
+    MemoryPlan();
+
+    TaskHandle_t createTask(TaskFunction_t function, const char *name, uint32_t stackSize, void *parameter, UBaseType_t priority,
+                            StackType_t *stack, StaticTask_t *buffer, BaseType_t core);
+    QueueHandle_t createQueue(const char *name, uint32_t length, uint32_t itemSize, uint8_t *storage, StaticQueue_t *buffer);
+
+    void report(Print *output);
+
+   private:
+    PlannedTask _tasks[MEMORY_TASKS_MAX];
+    uint8_t _taskCount;
+    PlannedQueue _queues[MEMORY_QUEUES_MAX];
+    uint8_t _queueCount;
+};
+
+#endif
@@ -0,0 +1,12 @@
+#include "message.h"
+
+const char *eventName(Event event) {
+    static char const *eventNames[14] = {"EVENT_SEND_ERROR", "EVENT_BUTTON_RESET", "EVENT_MESSAGE_INIT", "EVENT_MESSAGE_ACK", "EVENT_MESSAGE_FINISH",
+                                         "EVENT_DETECTOR_OBJECT_LEFT", "EVENT_DETECTOR_OBJECT_ARRIVED", "EVENT_RUN_CONFIRMED", "EVENT_TIMEOUT",
+                                         "EVENT_SYNC_PING", "EVENT_SYNC_PONG", "EVENT_BENCH_PING", "EVENT_BENCH_PONG", "EVENT_ANNOUNCE"};
+    if (event >= 0 && event < 14) {
+        return eventNames[event];
+    } else {
+        return "UNDEFINED";
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef message_h
+#define message_h
+
+#include <Arduino.h>
+
+#include "peers.h"
+
+typedef enum {
+    EVENT_SEND_ERROR,
+    EVENT_BUTTON_RESET,
+    EVENT_MESSAGE_INIT,
+    EVENT_MESSAGE_ACK,
+    EVENT_MESSAGE_FINISH,
+    EVENT_DETECTOR_OBJECT_LEFT,
+    EVENT_DETECTOR_OBJECT_ARRIVED,
+    EVENT_RUN_CONFIRMED,
+    EVENT_TIMEOUT,
+    EVENT_SYNC_PING,
+    EVENT_SYNC_PONG,
+    EVENT_BENCH_PING,
+    EVENT_BENCH_PONG,
+    EVENT_ANNOUNCE
+} Event;
+
+// Types
+typedef struct Message {
+    Event event;
+    int64_t time;                 // [us], meaning depends on the event, absolute times are in the start device clock
+    int64_t receiveTime;          // [us] ping arrival at the start device (EVENT_SYNC_PONG only)
+    int64_t sendTime;             // [us] stamped by communicationTask right before sending
+    uint16_t size;                // [B] frame size on air (EVENT_BENCH_* only)
+    uint16_t run;                 // run id given by the start device (EVENT_RUN_CONFIRMED, EVENT_MESSAGE_FINISH)
+    uint8_t peer = PEER_DEFAULT;  // peer table index - source of a received message, destination of a sent one
+    uint8_t role;                 // sender role and split gate number, stamped by the link
+    uint8_t gate;
+    uint16_t trace = 0;           // latency trace correlation id, see tracer.h
+    int64_t traceOrigin;          // [us] crossing time the traced stages are measured from (start device clock)
+} Message;
+
+// used for logging/debuggin purposes
+const char *eventName(Event event);
+
+#endif
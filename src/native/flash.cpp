@@ -0,0 +1,45 @@
+#include "flash.h"
+
+#include <esp_partition.h>
+
+#include <string.h>
+
+#include <vector>
+
+static std::vector<uint8_t> _flash;
+static esp_partition_t _partition;
+
+void flashReset(uint32_t size) {
+    _flash.assign(size, 0xff);
+    _partition.size = size;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t, esp_partition_subtype_t, const char *) {
+    return _flash.empty() ? NULL : &_partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *, size_t offset, void *dst, size_t size) {
+    if (offset + size > _flash.size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, &_flash[offset], size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *, size_t offset, const void *src, size_t size) {
+    if (offset + size > _flash.size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t i = 0; i < size; i++) {
+        _flash[offset + i] &= ((const uint8_t *)src)[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *, size_t offset, size_t size) {
+    if (offset + size > _flash.size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(&_flash[offset], 0xff, size);
+    return ESP_OK;
+}
@@ -0,0 +1,20 @@
+#ifndef flash_h
+#define flash_h
+
+#include <stdint.h>
+
+/**
+ * @brief Erased (0xff) emulated flash of the given size, every partition lookup returns it.
+ *
+ * Writes clear bits only, as on the NOR flash - writing over stale data without an erase garbles it.
+ */
+void flashReset(uint32_t size);
+
+/**
+ * @brief Results journal recovery after a power loss while the head sector was being prepared.
+ *
+ * @return 0 when every appended record reads back, 1 otherwise
+ */
+int checkJournalRecovery();
+
+#endif
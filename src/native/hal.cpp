@@ -0,0 +1,84 @@
+#include "hal.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "../detector.h"
+
+// HC-SR04 raises echo about 460us after the trigger (8 cycle burst at 40kHz + processing)
+#define ECHO_START_DELAY 460
+
+static const std::vector<TracePoint> *_trace = NULL;
+static size_t _traceIdx = 0;
+static int64_t _time = 0;
+
+void halSetTrace(const std::vector<TracePoint> *trace) {
+    _trace = trace;
+    _traceIdx = 0;
+    _time = trace->empty() ? 0 : trace->front().time;
+}
+
+void halAdvance(int64_t us) {
+    _time += us;
+}
+
+int64_t halTime() {
+    return _time;
+}
+
+static float sceneDistance() {
+    while (_traceIdx + 1 < _trace->size() && (*_trace)[_traceIdx + 1].time <= _time) {
+        _traceIdx++;
+    }
+    return (*_trace)[_traceIdx].distance;
+}
+
+int64_t esp_timer_get_time() {
+    return _time;
+}
+
+unsigned long millis() {
+    return (unsigned long)(_time / 1000);
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t, uint8_t) {
+}
+
+// pulseIn() returns with the echo over, the pin is low again
+int digitalRead(uint8_t) {
+    return LOW;
+}
+
+void delayMicroseconds(uint32_t us) {
+    _time += us;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    _time += (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+QueueHandle_t xQueueCreateStatic(uint32_t, uint32_t, uint8_t *, StaticQueue_t *buffer) {
+    return buffer;
+}
+
+BaseType_t xQueueSend(QueueHandle_t, const void *, TickType_t) {
+    return pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t, void *, TickType_t) {
+    return pdFALSE;
+}
+
+unsigned long pulseIn(uint8_t, uint8_t, unsigned long timeout) {
+    float distance = sceneDistance();
+    unsigned long duration = distance < 0 ? timeout : (unsigned long)(distance / SOUND_SPEED_HALF);
+    if (distance < 0 || ECHO_START_DELAY + duration > timeout) {
+        _time += timeout;
+        return 0;
+    }
+    _time += ECHO_START_DELAY + duration;
+    return duration;
+}
@@ -0,0 +1,29 @@
+#ifndef hal_h
+#define hal_h
+
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Scene seen by the ultrasonic sensor, piecewise constant between the points.
+ */
+typedef struct TracePoint {
+    int64_t time;    // [us]
+    float distance;  // [cm], negative when there is nothing to reflect from
+    bool present;    // ground truth - an object is crossing the gate
+} TracePoint;
+
+/**
+ * @brief Sets the scene the virtual sensor measures and resets the virtual clock.
+ */
+void halSetTrace(const std::vector<TracePoint> *trace);
+
+/**
+ * @brief Advances the virtual clock, stands for vTaskDelay() of the sampling task.
+ */
+void halAdvance(int64_t us);
+
+int64_t halTime();
+
+#endif
@@ -0,0 +1,61 @@
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../journal.h"
+#include "flash.h"
+
+#define CHECK_SECTORS 4
+#define CHECK_SLOTS_PER_SECTOR (JOURNAL_SECTOR_SIZE / sizeof(JournalRecord))
+#define CHECK_APPENDED (CHECK_SLOTS_PER_SECTOR + 8)  // fills the head sector and goes on into the next one
+
+/**
+ * The whole partition holds a round of old records and the head wraps onto the oldest sector - the
+ * power was lost before its erase. The recovery erases the head sector and the following one, the
+ * sector after the head is then kept erased at every step and all the appended records read back.
+ */
+int checkJournalRecovery() {
+    flashReset(CHECK_SECTORS * JOURNAL_SECTOR_SIZE);
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, JOURNAL_PARTITION_SUBTYPE, JOURNAL_PARTITION_NAME);
+    uint32_t slots = CHECK_SECTORS * CHECK_SLOTS_PER_SECTOR;
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        JournalRecord record;
+        memset(&record, 0, sizeof(record));
+        record.sequence = slot + 1;
+        record.run = slot;
+        record.crc = esp_rom_crc32_le(0, (const uint8_t *)&record, offsetof(JournalRecord, crc));
+        esp_partition_write(partition, slot * sizeof(JournalRecord), &record, sizeof(record));
+    }
+
+    // the newest record is in the last slot, the head starts over at 0
+    Journal journal;
+    journal.init();
+    uint16_t prepared = 0;
+    for (uint16_t i = 0; i <= CHECK_APPENDED; i++) {
+        if (i > 0) {
+            JournalRecord record;
+            memset(&record, 0, sizeof(record));
+            record.run = 1000 + i - 1;
+            journal.append(record);
+        }
+        uint32_t next = (i / CHECK_SLOTS_PER_SECTOR + 1) * CHECK_SLOTS_PER_SECTOR % slots;
+        uint32_t sequence;
+        esp_partition_read(partition, next * sizeof(JournalRecord), &sequence, sizeof(sequence));
+        if (sequence == JOURNAL_EMPTY) {
+            prepared++;
+        }
+    }
+
+    uint16_t readable = 0;
+    for (uint16_t n = 0; n < CHECK_APPENDED; n++) {
+        JournalRecord record;
+        if (journal.get(n, record) && record.run == 1000 + CHECK_APPENDED - 1 - n) {
+            readable++;
+        }
+    }
+    bool ok = prepared == CHECK_APPENDED + 1 && readable == CHECK_APPENDED;
+    printf("journal recovery: next sector erased %u/%u times, %u/%u records readable: %s\n", prepared, (unsigned)CHECK_APPENDED + 1,
+           readable, (unsigned)CHECK_APPENDED, ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+/**
+ * Detector trace replay harness.
+ *
+ * Replays distance traces through the real Detector::read() under virtual time and reports
+ * detection latency, crossing time error and false ARRIVED/LEFT events per trace.
+ *
+ * Usage: program [--window N] [--arrive CM] [--leave CM] [--median] [--timeouts N] [--learn] [--adaptive] [trace.csv ...]
+ *        program --check
+ *
+ * --learn keeps learning the background during the whole trace (READY on the device).
+ * The rounds follow the cadence of the real SamplingScheduler, fast as in the timing critical states
+ * (READY, RUN) unless --adaptive leaves it to the scene (fast on an approach, normal or sparse).
+ * --check replays the clean traces and the far side one against the learned background, with the
+ * median filter and with tolerated timeouts, and fails (exit code 1) when the average crossing time
+ * error exceeds one sample period. It also recovers the results journal after a power loss in the
+ * middle of a sector erase, see journal_check.cpp.
+ *
+ * Trace CSV lines are "time_us,distance_cm,present" (distance < 0 when no echo, present is
+ * the ground truth 0/1). Without traces a built-in set of synthetic ones is replayed.
+ */
+#include <ArduinoLog.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../detector.h"
+#include "../logging.h"
+#include "../sampling.h"
+#include "flash.h"
+#include "hal.h"
+
+#define MATCH_WINDOW 500000     // [us] a detection later than that is not matched to the crossing
+#define MATCH_EARLY 20000       // [us] tolerance of detections (slightly) before the ground truth
+
+Logging Log;
+
+static bool critical = true;  // cadence of the timing critical states, see SamplingScheduler
+
+// deferred logging is compiled out as well
+DeferredLogging DLog;
+DeferredLogging::DeferredLogging() {
+}
+void DeferredLogging::errorln(const char *, ...) {
+}
+void DeferredLogging::infoln(const char *, ...) {
+}
+
+typedef struct Transition {
+    int64_t time;
+    DetectedObjectState state;
+    bool matched;
+} Transition;
+
+typedef struct Stats {
+    int expected;
+    int detected;
+    int falseEvents;
+    double latencySum;
+    int64_t latencyMax;
+    double errorSum;
+    int64_t errorMaxAbs;
+} Stats;
+
+/**
+ * Synthetic trace: background distance with athletes passing at the given distance, gaussian noise
+ * and random echo dropouts, 1ms resolution.
+ */
+std::vector<TracePoint> syntheticTrace(float background, float object, float noise, float dropout, int passes, int64_t passDuration,
+                                       unsigned seed) {
+    std::mt19937 random(seed);
+    std::normal_distribution<float> gauss(0, noise);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    std::vector<TracePoint> trace;
+    const int64_t gap = 2000000;
+    for (int64_t t = 0; t < passes * (gap + passDuration) + gap; t += 1000) {
+        int64_t phase = t % (gap + passDuration);
+        bool present = t < passes * (gap + passDuration) && phase >= gap;
+        TracePoint point;
+        point.time = t;
+        point.present = present;
+        point.distance = present ? object : background;
+        if (point.distance > 0) {
+            point.distance = max(2.0f, point.distance + gauss(random));
+        }
+        if (uniform(random) < dropout) {
+            point.distance = -1;
+        }
+        trace.push_back(point);
+    }
+    return trace;
+}
+
+bool loadTrace(const char *fileName, std::vector<TracePoint> &trace) {
+    FILE *file = fopen(fileName, "r");
+    if (file == NULL) {
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        long long time;
+        float distance;
+        int present = 0;
+        if (sscanf(line, "%lld,%f,%d", &time, &distance, &present) >= 2) {
+            TracePoint point = {time, distance, present != 0};
+            trace.push_back(point);
+        }
+    }
+    fclose(file);
+    return !trace.empty();
+}
+
+// ground truth ARRIVED/LEFT transitions of the trace
+std::vector<Transition> groundTruth(const std::vector<TracePoint> &trace) {
+    std::vector<Transition> transitions;
+    bool present = false;
+    for (size_t i = 0; i < trace.size(); i++) {
+        if (trace[i].present != present) {
+            present = trace[i].present;
+            Transition transition = {trace[i].time, present ? ARRIVED : LEFT, false};
+            transitions.push_back(transition);
+        }
+    }
+    return transitions;
+}
+
+void addStats(Stats &stats, int64_t latency, int64_t error) {
+    stats.detected++;
+    stats.latencySum += latency;
+    stats.latencyMax = max(stats.latencyMax, latency);
+    stats.errorSum += error;
+    stats.errorMaxAbs = max(stats.errorMaxAbs, error < 0 ? -error : error);
+}
+
+void printStats(const char *name, const char *event, const Stats &stats) {
+    printf("%-28s %-7s %3d/%-3d %6d", name, event, stats.detected, stats.expected, stats.falseEvents);
+    if (stats.detected > 0) {
+        printf(" %9.1f %9.1f %9.1f %9.1f\n", stats.latencySum / stats.detected / 1000.0, stats.latencyMax / 1000.0,
+               stats.errorSum / stats.detected / 1000.0, stats.errorMaxAbs / 1000.0);
+    } else {
+        printf(" %9s %9s %9s %9s\n", "-", "-", "-", "-");
+    }
+}
+
+/**
+ * @return the worst average crossing time error relative to the sample period (1 = one period)
+ */
+double replay(const char *name, const std::vector<TracePoint> &trace, DetectorConfig config, bool learn) {
+    Detector detector;
+    detector.setConfig(config);
+    detector.setLearning(learn);
+    detector.init();
+    detector.startMeasurement();
+    SamplingScheduler sampling;
+    sampling.setCritical(critical);
+    halSetTrace(&trace);
+
+    std::vector<Transition> truth = groundTruth(trace);
+    Stats stats[2];
+    memset(stats, 0, sizeof(stats));
+    for (size_t i = 0; i < truth.size(); i++) {
+        stats[truth[i].state == ARRIVED ? 0 : 1].expected++;
+    }
+
+    int64_t begin = halTime();
+    int64_t end = trace.back().time;
+    int reads = 0;
+    while (halTime() < end) {
+        reads++;
+        DetectedObjectState state = detector.read();
+        if (state != NONE) {
+            Stats &s = stats[state == ARRIVED ? 0 : 1];
+            int64_t reportTime = halTime();
+            Transition *match = NULL;
+            for (size_t i = 0; i < truth.size() && match == NULL; i++) {
+                if (!truth[i].matched && truth[i].state == state && reportTime >= truth[i].time - MATCH_EARLY &&
+                    reportTime <= truth[i].time + MATCH_WINDOW) {
+                    match = &truth[i];
+                }
+            }
+            if (match == NULL) {
+                s.falseEvents++;
+            } else {
+                match->matched = true;
+                addStats(s, reportTime - match->time, detector.getCrossingTime() - match->time);
+            }
+        }
+        // the delay is rounded up to whole ticks as in readDetectorTask
+        int64_t delay = sampling.next(true, detector, halTime());
+        vTaskDelay((delay + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000));
+    }
+    printStats(name, "ARRIVED", stats[0]);
+    printStats(name, "LEFT", stats[1]);
+
+    // the echo wait adds to the sleep, the period depends on the scene
+    double period = (double)(halTime() - begin) / reads;
+    double worst = 0;
+    for (int i = 0; i < 2; i++) {
+        if (stats[i].detected > 0) {
+            worst = max(worst, fabs(stats[i].errorSum / stats[i].detected) / period);
+        }
+    }
+    return worst;
+}
+
+void printHeader(const DetectorConfig &config, bool learn) {
+    printf("window %d, arrive %.0f cm, leave %.0f cm, median %d, max timeouts %d, learned background %d, sampling %s\n", config.windowSize,
+           config.arriveThreshold, config.leaveThreshold, config.medianFilter, config.maxTimeouts, learn, critical ? "fast" : "adaptive");
+    printf("%-28s %-7s %7s %6s %9s %9s %9s %9s\n", "trace", "event", "found", "false", "lat.avg", "lat.max", "err.avg", "err.max");
+    printf("%-28s %-7s %7s %6s %9s %9s %9s %9s\n", "", "", "", "", "[ms]", "[ms]", "[ms]", "[ms]");
+}
+
+/**
+ * The crossing is stamped with the first sample past the threshold, not with the oldest one of the
+ * confirming window - the error stays within one sample period whatever the window size and filter.
+ */
+int checkCrossingTime(DetectorConfig defaults) {
+    DetectorConfig configs[2] = {defaults, defaults};
+    configs[0].windowSize = 5;
+    configs[0].medianFilter = true;
+    configs[1].windowSize = 5;
+    configs[1].maxTimeouts = 1;
+    double worst = 0;
+    for (int i = 0; i < 2; i++) {
+        printHeader(configs[i], false);
+        worst = max(worst, replay("clean, open field", syntheticTrace(-1, 40, 0.5, 0, 20, 300000, 1), configs[i], false));
+        worst = max(worst, replay("clean, wall 120cm", syntheticTrace(120, 40, 0.5, 0, 20, 300000, 2), configs[i], false));
+        worst = max(worst, replay("fast pass 60ms", syntheticTrace(-1, 40, 2, 0.02, 20, 60000, 7), configs[i], false));
+        worst = max(worst, replay("far side, learned", syntheticTrace(130, 90, 2, 0.02, 20, 300000, 8), configs[i], true));
+    }
+    printf("crossing time error up to %.2f sample periods: %s\n", worst, worst <= 1 ? "OK" : "FAILED");
+    return worst <= 1 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    Detector defaults;
+    DetectorConfig config = defaults.getConfig();
+    std::vector<const char *> files;
+    bool learn = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            config.windowSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--arrive") == 0 && i + 1 < argc) {
+            config.arriveThreshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--leave") == 0 && i + 1 < argc) {
+            config.leaveThreshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--median") == 0) {
+            config.medianFilter = true;
+        } else if (strcmp(argv[i], "--timeouts") == 0 && i + 1 < argc) {
+            config.maxTimeouts = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--learn") == 0) {
+            learn = true;
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            critical = false;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            int crossing = checkCrossingTime(config);
+            return checkJournalRecovery() | crossing;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    printHeader(config, learn);
+
+    if (files.empty()) {
+        replay("clean, open field", syntheticTrace(-1, 40, 0.5, 0, 20, 300000, 1), config, learn);
+        replay("clean, wall 120cm", syntheticTrace(120, 40, 0.5, 0, 20, 300000, 2), config, learn);
+        replay("noisy 5cm", syntheticTrace(-1, 40, 5, 0, 20, 300000, 3), config, learn);
+        replay("dropouts 5%", syntheticTrace(-1, 40, 2, 0.05, 20, 300000, 4), config, learn);
+        replay("dropouts 20%", syntheticTrace(-1, 40, 2, 0.2, 20, 300000, 5), config, learn);
+        replay("edge of lane 65cm", syntheticTrace(-1, 65, 4, 0.1, 20, 300000, 6), config, learn);
+        replay("fast pass 60ms", syntheticTrace(-1, 40, 2, 0.02, 20, 60000, 7), config, learn);
+        replay("far side 90cm, wall 130cm", syntheticTrace(130, 90, 2, 0.02, 20, 300000, 8), config, learn);
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+        std::vector<TracePoint> trace;
+        if (!loadTrace(files[i], trace)) {
+            fprintf(stderr, "Cannot read trace %s\n", files[i]);
+            return 1;
+        }
+        std::string name = files[i];
+        replay(name.substr(name.find_last_of('/') + 1).c_str(), trace, config, learn);
+    }
+    return 0;
+}
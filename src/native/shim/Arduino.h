@@ -0,0 +1,70 @@
+#ifndef native_arduino_h
+#define native_arduino_h
+
+// Minimal Arduino API for the host build, just what the detector and the journal need. Time is
+// virtual, see hal.cpp.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 0x03
+#define INPUT_PULLDOWN 0x09
+#define IRAM_ATTR
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef bool boolean;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef void *QueueHandle_t;
+typedef struct StaticQueue_t {
+    void *dummy;
+} StaticQueue_t;
+
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY 0xffffffff
+#define pdTRUE 1
+#define pdFALSE 0
+
+class Print {
+   public:
+    virtual size_t write(uint8_t c) {
+        return fputc(c, stdout) == EOF ? 0 : 1;
+    }
+    size_t print(const char *s) {
+        return fputs(s, stdout);
+    }
+    size_t printf(const char *format, ...) {
+        va_list args;
+        va_start(args, format);
+        int length = vprintf(format, args);
+        va_end(args);
+        return length < 0 ? 0 : length;
+    }
+};
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void delayMicroseconds(uint32_t us);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout);
+unsigned long millis();
+void vTaskDelay(TickType_t ticks);
+
+// there are no tasks on the host, the queues stay empty
+QueueHandle_t xQueueCreateStatic(uint32_t length, uint32_t itemSize, uint8_t *storage, StaticQueue_t *buffer);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef native_arduino_log_h
+#define native_arduino_log_h
+
+// Logging is compiled out on the host, the replay harness prints its own report.
+
+class Logging {
+   public:
+    template <class T, typename... Args>
+    void info(T, Args...) {
+    }
+    template <class T, typename... Args>
+    void infoln(T, Args...) {
+    }
+    template <class T, typename... Args>
+    void errorln(T, Args...) {
+    }
+};
+
+extern Logging Log;
+
+#endif
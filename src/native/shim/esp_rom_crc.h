@@ -0,0 +1,18 @@
+#ifndef native_esp_rom_crc_h
+#define native_esp_rom_crc_h
+
+#include <stdint.h>
+
+// CRC32 little endian as the ROM computes it (zlib compatible, the crc argument chains the calls)
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef native_esp_timer_h
+#define native_esp_timer_h
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time();
+
+#endif
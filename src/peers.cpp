@@ -0,0 +1,161 @@
+#include "peers.h"
+
+#include <Preferences.h>
+
+#include "logging.h"
+
+static const uint8_t broadcastAddress[ESP_NOW_ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+PeerTable::PeerTable() {
+    _role = ROLE_START;
+    _gate = 0;
+    _count = 0;
+    _offers = NULL;
+}
+
+void PeerTable::loadRole(Role defaultRole) {
+    Preferences preferences;
+    preferences.begin(PEERS_NAMESPACE, true);
+    _role = (Role)preferences.getUChar("role", defaultRole);
+    _gate = preferences.getUChar("gate", 0);
+    preferences.end();
+}
+
+Role PeerTable::getRole() {
+    return _role;
+}
+
+uint8_t PeerTable::getGate() {
+    return _gate;
+}
+
+void PeerTable::setRole(Role role, uint8_t gate) {
+    Preferences preferences;
+    preferences.begin(PEERS_NAMESPACE, false);
+    preferences.putUChar("role", role);
+    preferences.putUChar("gate", gate);
+    preferences.end();
+    _role = role;
+    _gate = gate;
+}
+
+void PeerTable::init() {
+    _offers = xQueueCreateStatic(PEERS_MAX, sizeof(Peer), _offersStorage, &_offersBuffer);
+
+    esp_now_peer_info_t peerInfo = {};
+    memcpy(peerInfo.peer_addr, broadcastAddress, ESP_NOW_ETH_ALEN);
+    if (esp_now_add_peer(&peerInfo) != ESP_OK) {
+        Log.errorln("Failed to add the broadcast peer");
+    }
+
+    Peer stored[PEERS_MAX];
+    Preferences preferences;
+    preferences.begin(PEERS_NAMESPACE, true);
+    size_t size = preferences.getBytes("peers", stored, sizeof(stored));
+    preferences.end();
+    for (uint8_t i = 0; i < size / sizeof(Peer); i++) {
+        add(stored[i]);
+    }
+    Log.infoln("Peers loaded: %d", _count);
+}
+
+bool PeerTable::add(const Peer &peer) {
+    if (_count >= PEERS_MAX || find(peer.address) >= 0) {
+        return false;
+    }
+    esp_now_peer_info_t peerInfo = {};
+    memcpy(peerInfo.peer_addr, peer.address, ESP_NOW_ETH_ALEN);
+    peerInfo.channel = 0;
+    peerInfo.encrypt = false;
+    if (esp_now_add_peer(&peerInfo) != ESP_OK) {
+        DLog.errorln("Failed to add peer");
+        return false;
+    }
+    _peers[_count] = peer;
+    _count = _count + 1;  // published after the entry is complete
+    return true;
+}
+
+int8_t PeerTable::find(const uint8_t *address) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (memcmp(_peers[i].address, address, ESP_NOW_ETH_ALEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int8_t PeerTable::findRole(Role role) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_peers[i].role == role) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint8_t PeerTable::getCount() {
+    return _count;
+}
+
+const Peer &PeerTable::get(uint8_t index) {
+    return _peers[index];
+}
+
+// gates need the start device only, the start device needs everybody
+bool PeerTable::offer(const uint8_t *address, uint8_t role, uint8_t gate) {
+    if (find(address) >= 0 || (_role != ROLE_START && role != ROLE_START)) {
+        return false;
+    }
+    Peer peer;
+    memcpy(peer.address, address, ESP_NOW_ETH_ALEN);
+    peer.role = role;
+    peer.gate = gate;
+    return xQueueSend(_offers, &peer, 0) == pdTRUE;
+}
+
+void PeerTable::commit() {
+    Peer peer;
+    bool added = false;
+    while (xQueueReceive(_offers, &peer, 0) == pdTRUE) {
+        if (add(peer)) {
+            DLog.infoln("New peer %s %d", roleName(peer.role), peer.gate);
+            added = true;
+        }
+    }
+    if (added) {
+        save();
+    }
+}
+
+void PeerTable::save() {
+    Preferences preferences;
+    preferences.begin(PEERS_NAMESPACE, false);
+    preferences.putBytes("peers", _peers, _count * sizeof(Peer));
+    preferences.end();
+}
+
+void PeerTable::clear() {
+    Preferences preferences;
+    preferences.begin(PEERS_NAMESPACE, false);
+    preferences.remove("peers");
+    preferences.end();
+}
+
+void PeerTable::print(Print *output) {
+    output->printf("Role %s, gate %u\r\n", roleName(_role), _gate);
+    for (uint8_t i = 0; i < _count; i++) {
+        const Peer &peer = _peers[i];
+        output->printf("  %u: %02X:%02X:%02X:%02X:%02X:%02X %s %u\r\n", i, peer.address[0], peer.address[1], peer.address[2], peer.address[3],
+                       peer.address[4], peer.address[5], roleName(peer.role), peer.gate);
+    }
+}
+
+const char *PeerTable::roleName(uint8_t role) {
+    static char const *roleNames[3] = {"start", "finish", "split"};
+    if (role < 3) {
+        return roleNames[role];
+    } else {
+        return "UNDEFINED";
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef peers_h
+#define peers_h
+
+#include <Arduino.h>
+#include <esp_now.h>
+
+#define PEERS_MAX 10          // start device table - finish and up to 8 split gates (+ spare)
+#define PEERS_DISCOVERY 2000  // [ms] announce period while not running
+#define PEERS_NAMESPACE "gates"
+
+// Message.peer values besides the peer table indexes
+#define PEER_DEFAULT 0xff    // destination - all peers on the start device, the start device on the others
+#define PEER_BROADCAST 0xfe  // destination - ESP-NOW broadcast (discovery)
+#define PEER_UNKNOWN 0xfd    // source - sender not in the table (discovery)
+
+typedef enum {
+    ROLE_START,
+    ROLE_FINISH,
+    ROLE_SPLIT
+} Role;
+
+typedef struct Peer {
+    uint8_t address[ESP_NOW_ETH_ALEN];
+    uint8_t role;
+    uint8_t gate;  // split gate number 1..8, 0 for start and finish
+} Peer;
+
+/**
+ * Device role and the table of known peers, both kept in NVS.
+ *
+ * Peers announce themselves over broadcast, the start device keeps every gate, the gates keep the start
+ * device only. Entries are appended only (clearing restarts the device), so the table can be read from
+ * the receive task without locking.
+ */
+class PeerTable {
+   public:
+    PeerTable();
+
+    /**
+     * @brief Loads the role, defaultRole is used when none was stored yet.
+     */
+    void loadRole(Role defaultRole);
+    Role getRole();
+    uint8_t getGate();
+    void setRole(Role role, uint8_t gate);
+
+    /**
+     * @brief Loads the stored peers and registers them (and the broadcast address) with ESP-NOW.
+     */
+    void init();
+
+    int8_t find(const uint8_t *address);
+    int8_t findRole(Role role);
+    uint8_t getCount();
+    const Peer &get(uint8_t index);
+
+    /**
+     * @brief Offers a peer announced over broadcast, callable from the receive task.
+     *
+     * @return true when the peer is new and commit() should run
+     */
+    bool offer(const uint8_t *address, uint8_t role, uint8_t gate);
+
+    /**
+     * @brief Adds the offered peers to the table and stores them, not from the receive task.
+     */
+    void commit();
+    void clear();
+    void print(Print *output);
+
+    static const char *roleName(uint8_t role);
+
+   private:
+    Role _role;
+    uint8_t _gate;
+    Peer _peers[PEERS_MAX];
+    volatile uint8_t _count;
+    QueueHandle_t _offers;
+    StaticQueue_t _offersBuffer;
+    uint8_t _offersStorage[PEERS_MAX * sizeof(Peer)];
+
+    bool add(const Peer &peer);
+    void save();
+};
+
+#endif
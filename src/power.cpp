@@ -0,0 +1,121 @@
+#include "power.h"
+
+#include <esp_idf_version.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+
+#include "logging.h"
+#include "timebase.h"
+
+// the ESP-NOW wake window exists since IDF 5, without it a sleeping modem misses the frames
+#if ESP_IDF_VERSION_MAJOR >= 5
+#define POWER_MODEM_SLEEP WIFI_PS_MIN_MODEM
+#else
+#define POWER_MODEM_SLEEP WIFI_PS_NONE
+#endif
+
+Power::Power() {
+    _enabled = false;
+    _timingCritical = false;
+    _cpuLock = NULL;
+    _sleepLock = NULL;
+    _state = 0;
+    _stateChangeTime = 0;
+    _criticalChangeTime = 0;
+    memset(_stateTime, 0, sizeof(_stateTime));
+    memset(_criticalTime, 0, sizeof(_criticalTime));
+}
+
+void Power::init() {
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_pm_config_t config;
+#else
+    esp_pm_config_esp32_t config;
+#endif
+    config.max_freq_mhz = POWER_MAX_CPU_FREQ;
+    config.min_freq_mhz = POWER_MIN_CPU_FREQ;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    config.light_sleep_enable = true;
+#else
+    config.light_sleep_enable = false;
+#endif
+    esp_err_t result = esp_pm_configure(&config);
+    if (result != ESP_OK) {
+        Log.errorln("Power management not available (%d)", result);
+        esp_wifi_set_ps(WIFI_PS_NONE);  // the Arduino core enables modem sleep by default
+        return;
+    }
+    esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "timing cpu", &_cpuLock);
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "timing sleep", &_sleepLock);
+    _enabled = true;
+
+    // modem sleep between the beacons, ESP-NOW needs the radio awake for a while in each interval
+    esp_wifi_set_ps(POWER_MODEM_SLEEP);
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_wifi_connectionless_module_set_wake_interval(100);
+    esp_now_set_wake_window(50);
+#endif
+}
+
+void Power::setTimingCritical(bool critical) {
+    if (critical == _timingCritical) {
+        return;
+    }
+    account(nowMicros());
+    _timingCritical = critical;
+    if (!_enabled) {
+        return;
+    }
+    if (critical) {
+        esp_pm_lock_acquire(_cpuLock);
+        esp_pm_lock_acquire(_sleepLock);
+        esp_wifi_set_ps(WIFI_PS_NONE);
+    } else {
+        esp_wifi_set_ps(POWER_MODEM_SLEEP);
+        esp_pm_lock_release(_sleepLock);
+        esp_pm_lock_release(_cpuLock);
+    }
+}
+
+bool Power::isTimingCritical() {
+    return _timingCritical;
+}
+
+void Power::account(int64_t now) {
+    if (_state < POWER_STATES) {
+        _stateTime[_state] += now - _stateChangeTime;
+        if (_timingCritical || !_enabled) {
+            _criticalTime[_state] += now - max(_stateChangeTime, _criticalChangeTime);
+        }
+    }
+    _stateChangeTime = now;
+    _criticalChangeTime = now;
+}
+
+void Power::onStateChange(uint8_t state) {
+    account(nowMicros());
+    _state = state;
+}
+
+void Power::report(Print *output, const char *(*stateName)(uint8_t)) {
+    account(nowMicros());
+    int64_t totalTime = 0;
+    double totalCharge = 0;  // [mA * us]
+    output->printf("Power (modelled, %s):\r\n", _enabled ? "power management on" : "power management off");
+    for (uint8_t i = 0; i < POWER_STATES; i++) {
+        if (_stateTime[i] == 0) {
+            continue;
+        }
+        double charge = (double)_criticalTime[i] * POWER_CURRENT_ACTIVE + (double)(_stateTime[i] - _criticalTime[i]) * POWER_CURRENT_SAVING +
+                        (double)_stateTime[i] * POWER_CURRENT_PERIPHERALS;
+        output->printf("  %-18s %8.1f s %6.1f mA\r\n", stateName(i), _stateTime[i] / 1e6, charge / _stateTime[i]);
+        totalTime += _stateTime[i];
+        totalCharge += charge;
+    }
+    if (totalTime > 0) {
+        double average = totalCharge / totalTime;
+        double baseline = POWER_CURRENT_ACTIVE + POWER_CURRENT_PERIPHERALS;
+        output->printf("  average %.1f mA, runtime %.1f h (%.1f h without power management)\r\n", average, POWER_BATTERY_CAPACITY / average,
+                       POWER_BATTERY_CAPACITY / baseline);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef power_h
+#define power_h
+
+#include <Arduino.h>
+#include <esp_pm.h>
+
+#define POWER_MAX_CPU_FREQ 240  // [MHz]
+#define POWER_MIN_CPU_FREQ 80   // [MHz] lowest frequency keeping the radio usable
+#define POWER_STATES 8          // state machine states tracked by the report
+
+// Current model of the report [mA], ESP32 datasheet values plus measured peripherals
+#define POWER_CURRENT_ACTIVE 110      // 240MHz, radio always on
+#define POWER_CURRENT_SAVING 30       // 80MHz with automatic light sleep and modem sleep
+#define POWER_CURRENT_PERIPHERALS 35  // display, ultrasonic sensor, LED and the step up
+#define POWER_BATTERY_CAPACITY 2500   // [mAh]
+
+/**
+ * Power management - dynamic frequency scaling, automatic light sleep and modem sleep outside
+ * of the timing critical phases.
+ *
+ * Light sleep needs CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE in the sdkconfig,
+ * without them init() reports it and the device keeps running at full speed. Modem sleep needs the
+ * ESP-NOW wake window of IDF 5, on IDF 4 (Arduino core 2.x) the radio stays on.
+ */
+class Power {
+   public:
+    Power();
+    void init();
+
+    /**
+     * @brief Holds the CPU at full speed with the radio always on (no light/modem sleep).
+     */
+    void setTimingCritical(bool critical);
+    bool isTimingCritical();
+
+    /**
+     * @brief Accounts the time spent in the previous state, call on every state change.
+     */
+    void onStateChange(uint8_t state);
+
+    /**
+     * @brief Prints time and modelled average current per state and the estimated runtime.
+     */
+    void report(Print *output, const char *(*stateName)(uint8_t));
+
+   private:
+    bool _enabled;
+    bool _timingCritical;
+    esp_pm_lock_handle_t _cpuLock;
+    esp_pm_lock_handle_t _sleepLock;
+
+    uint8_t _state;
+    int64_t _stateChangeTime;
+    int64_t _criticalChangeTime;
+    int64_t _stateTime[POWER_STATES];     // [us] total per state
+    int64_t _criticalTime[POWER_STATES];  // [us] of it with the lock held
+
+    void account(int64_t now);
+};
+
+#endif
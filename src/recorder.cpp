@@ -0,0 +1,240 @@
+#include "recorder.h"
+
+#include "logging.h"
+
+/**
+ * Print sink writing to a flash partition (already erased) or just counting the bytes.
+ */
+class PartitionPrint : public Print {
+   public:
+    PartitionPrint(const esp_partition_t *partition, uint32_t offset) {
+        _partition = partition;
+        _offset = offset;
+        _written = 0;
+        _length = 0;
+    }
+
+    size_t write(uint8_t c) override {
+        return write(&c, 1);
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override {
+        size_t total = size;
+        while (size > 0) {
+            size_t chunk = min(size, sizeof(_buffer) - _length);
+            memcpy(_buffer + _length, buffer, chunk);
+            _length += chunk;
+            buffer += chunk;
+            size -= chunk;
+            _written += chunk;
+            if (_length == sizeof(_buffer)) {
+                flush();
+            }
+        }
+        return total;
+    }
+
+    void flush() override {
+        if (_partition != NULL && _length > 0) {
+            esp_partition_write(_partition, _offset, _buffer, _length);
+        }
+        _offset += _length;
+        _length = 0;
+    }
+
+    uint32_t getWritten() {
+        return _written;
+    }
+
+   private:
+    const esp_partition_t *_partition;
+    uint32_t _offset;
+    uint32_t _written;
+    uint8_t _buffer[256];
+    size_t _length;
+};
+
+static void writeVarint(Print *output, uint32_t value) {
+    while (value >= 0x80) {
+        output->write((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    output->write((uint8_t)value);
+}
+
+static uint32_t alignSector(uint32_t offset) {
+    return (offset + RECORDER_SECTOR_SIZE - 1) / RECORDER_SECTOR_SIZE * RECORDER_SECTOR_SIZE;
+}
+
+Recorder::Recorder() {
+    _head = _count = 0;
+    _recording = false;
+    _persistent = false;
+    _runId = 0;
+    _partition = NULL;
+    _writeOffset = 0;
+    _mutex = NULL;
+}
+
+void Recorder::init() {
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)RECORDER_PARTITION_SUBTYPE, RECORDER_PARTITION_NAME);
+    if (_partition == NULL) {
+        Log.errorln("Trace partition not found");
+        return;
+    }
+    // continue after the newest stored run
+    for (uint32_t offset = 0; offset < _partition->size; offset += RECORDER_SECTOR_SIZE) {
+        RecorderHeader header;
+        esp_partition_read(_partition, offset, &header, sizeof(header));
+        if (header.magic == RECORDER_MAGIC && header.size < _partition->size && header.runId >= _runId) {
+            _runId = header.runId + 1;
+            _writeOffset = alignSector(offset + sizeof(header) + header.size);
+        }
+    }
+}
+
+void Recorder::startRun(int64_t time) {
+    if (_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _recording = false;
+    _head = _count = 0;
+    _startTime = time;
+    _runId++;
+    _recording = true;
+    xSemaphoreGive(_mutex);
+}
+
+void Recorder::stopRun() {
+    _recording = false;
+}
+
+bool Recorder::isRecording() {
+    return _recording;
+}
+
+void Recorder::record(int64_t time, uint16_t duration, uint8_t state) {
+    if (!_recording || xSemaphoreTake(_mutex, 0) != pdTRUE) {
+        return;  // not recording or the previous run is being written
+    }
+    if (!_recording) {
+        xSemaphoreGive(_mutex);
+        return;
+    }
+    uint16_t idx = (_head + _count) % RECORDER_CAPACITY;
+    if (_count == RECORDER_CAPACITY) {
+        _head = (_head + 1) % RECORDER_CAPACITY;
+    } else {
+        _count++;
+    }
+    _samples[idx].time = (uint32_t)(time - _startTime);
+    _samples[idx].duration = duration;
+    _samples[idx].state = state;
+    xSemaphoreGive(_mutex);
+}
+
+void Recorder::setPersistent(bool persistent) {
+    _persistent = persistent;
+}
+
+bool Recorder::isPersistent() {
+    return _persistent;
+}
+
+uint32_t Recorder::encode(Print *output) {
+    PartitionPrint counter(NULL, 0);
+    Print *sink = output != NULL ? output : &counter;
+    uint32_t prevTime = 0;
+    uint16_t prevDuration = 0;
+    for (uint16_t i = 0; i < _count; i++) {
+        const RecorderSample &sample = _samples[(_head + i) % RECORDER_CAPACITY];
+        int32_t durationDelta = (int32_t)sample.duration - prevDuration;
+        writeVarint(sink, sample.time - prevTime);
+        writeVarint(sink, ((uint32_t)durationDelta << 1) ^ (uint32_t)(durationDelta >> 31));  // zigzag
+        sink->write(sample.state);
+        prevTime = sample.time;
+        prevDuration = sample.duration;
+    }
+    return counter.getWritten();
+}
+
+// header of the last run, the caller holds the lock until its samples are encoded
+void Recorder::fillHeader(RecorderHeader &header) {
+    header.magic = RECORDER_MAGIC;
+    header.runId = _runId;
+    header.startTime = _startTime;
+    header.count = _count;
+    header.size = encode(NULL);
+}
+
+bool Recorder::persist() {
+    if (_partition == NULL) {
+        return false;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_recording || _count == 0) {
+        xSemaphoreGive(_mutex);
+        return false;
+    }
+    RecorderHeader header;
+    fillHeader(header);
+
+    uint32_t length = alignSector(sizeof(header) + header.size);
+    if (length > _partition->size) {
+        xSemaphoreGive(_mutex);
+        return false;
+    }
+    if (_writeOffset + length > _partition->size) {
+        _writeOffset = 0;
+    }
+    if (esp_partition_erase_range(_partition, _writeOffset, length) != ESP_OK) {
+        xSemaphoreGive(_mutex);
+        DLog.errorln("Trace partition erase failed");
+        return false;
+    }
+    PartitionPrint output(_partition, _writeOffset);
+    output.write((const uint8_t *)&header, sizeof(header));
+    encode(&output);
+    output.flush();
+    _writeOffset += length;
+    xSemaphoreGive(_mutex);
+    DLog.infoln("Trace of run %d stored, %d samples, %d B", header.runId, header.count, header.size);
+    return true;
+}
+
+void Recorder::dump(Print *output) {
+    if (_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (!_recording) {  // the sampling task writes the buffer otherwise
+        RecorderHeader header;
+        fillHeader(header);
+        output->write((const uint8_t *)&header, sizeof(header));
+        encode(output);
+    }
+    xSemaphoreGive(_mutex);
+}
+
+void Recorder::dumpStored(Print *output) {
+    if (_partition == NULL) {
+        return;
+    }
+    uint8_t buffer[256];
+    for (uint32_t offset = 0; offset < _partition->size; offset += RECORDER_SECTOR_SIZE) {
+        RecorderHeader header;
+        esp_partition_read(_partition, offset, &header, sizeof(header));
+        if (header.magic != RECORDER_MAGIC || header.size >= _partition->size) {
+            continue;
+        }
+        uint32_t length = sizeof(header) + header.size;
+        for (uint32_t position = 0; position < length; position += sizeof(buffer)) {
+            uint32_t chunk = min((uint32_t)sizeof(buffer), length - position);
+            esp_partition_read(_partition, offset + position, buffer, chunk);
+            output->write(buffer, chunk);
+        }
+        offset = alignSector(offset + length) - RECORDER_SECTOR_SIZE;
+    }
+}
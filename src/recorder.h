@@ -0,0 +1,100 @@
+#ifndef recorder_h
+#define recorder_h
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#define RECORDER_CAPACITY 3072              // samples kept in RAM, the oldest ones are overwritten
+#define RECORDER_PARTITION_NAME "traces"
+#define RECORDER_PARTITION_SUBTYPE 0x40
+#define RECORDER_MAGIC 0x31525446           // "FTR1"
+#define RECORDER_SECTOR_SIZE 4096
+
+// RecorderSample.state bits
+#define RECORDER_STATE_EVENT_MASK 0x03      // DetectedObjectState reported by the sample
+#define RECORDER_STATE_OBJECT_DETECTED 0x04 // detector considers the object present
+#define RECORDER_STATE_SENSOR_MASK 0x30     // sensor of the gate which took the sample
+#define RECORDER_STATE_SENSOR_SHIFT 4
+
+typedef struct RecorderSample {
+    uint32_t time;      // [us] since the run start
+    uint16_t duration;  // [us] echo duration, 0 on timeout
+    uint8_t state;      // RECORDER_STATE_* bits
+} RecorderSample;
+
+/**
+ * Header of a stored/dumped run, followed by `size` bytes of delta encoded samples.
+ * Each sample is varint(time delta), varint(zigzag(duration delta)), state byte.
+ * The first sample is encoded against time 0 and duration 0.
+ */
+typedef struct RecorderHeader {
+    uint32_t magic;
+    uint32_t runId;
+    int64_t startTime;  // [us] absolute time of the run start
+    uint32_t count;     // number of samples
+    uint32_t size;      // [B] encoded samples
+} RecorderHeader;
+
+/**
+ * Raw detector sample recorder.
+ *
+ * Samples go to a RAM ring buffer, record() only does a few stores so it can be called from
+ * the sampling loop. A finished run can be persisted to the "traces" flash partition (runs are
+ * sector aligned, the partition is used as a circular buffer) and dumped over serial.
+ *
+ * persist() and dump() encode the ring twice (size, then data) while holding the lock, startRun()
+ * waits for them and record() drops the sample rather than waiting - the ring never changes between
+ * the passes.
+ */
+class Recorder {
+   public:
+    Recorder();
+    void init();
+
+    /**
+     * @brief Clears the ring for a new run, waits for a persist()/dump() of the previous one in progress.
+     */
+    void startRun(int64_t time);
+    void stopRun();
+    bool isRecording();
+
+    void record(int64_t time, uint16_t duration, uint8_t state);
+
+    void setPersistent(bool persistent);
+    bool isPersistent();
+
+    /**
+     * @brief Writes the last run to flash, slow (erases sectors), call it outside of the timing phases.
+     */
+    bool persist();
+
+    /**
+     * @brief Writes the last run in the binary format.
+     */
+    void dump(Print *output);
+
+    /**
+     * @brief Writes all runs stored in flash in the binary format.
+     */
+    void dumpStored(Print *output);
+
+   private:
+    RecorderSample _samples[RECORDER_CAPACITY];
+    uint16_t _head;  // oldest sample
+    uint16_t _count;
+    volatile bool _recording;
+    bool _persistent;
+    uint32_t _runId;
+    int64_t _startTime;
+
+    const esp_partition_t *_partition;
+    uint32_t _writeOffset;
+
+    SemaphoreHandle_t _mutex;  // ring and run state
+    StaticSemaphore_t _mutexBuffer;
+
+    uint32_t encode(Print *output);
+    void fillHeader(RecorderHeader &header);
+};
+
+#endif
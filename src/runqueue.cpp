@@ -0,0 +1,68 @@
+#include "runqueue.h"
+
+#include "logging.h"
+
+RunQueue::RunQueue() {
+    _head = 0;
+    _count = 0;
+}
+
+Run &RunQueue::at(uint8_t index) {
+    return _runs[(_head + index) % RUNS_MAX];
+}
+
+Run *RunQueue::push(uint16_t id, int64_t startTime) {
+    if (_count == RUNS_MAX) {
+        DLog.errorln("Too many runs on course, the oldest one is dropped");
+        pop();
+    }
+    Run &run = at(_count++);
+    run.id = id;
+    run.startTime = startTime;
+    run.lastCrossingTime = startTime;
+    run.gate = 0;
+    memset(run.splits, 0, sizeof(run.splits));
+    return &run;
+}
+
+Run *RunQueue::front() {
+    return _count > 0 ? &at(0) : NULL;
+}
+
+Run *RunQueue::findForGate(uint8_t gate) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (at(i).gate < gate) {
+            return &at(i);
+        }
+    }
+    return NULL;
+}
+
+void RunQueue::pop() {
+    if (_count > 0) {
+        _head = (_head + 1) % RUNS_MAX;
+        _count--;
+    }
+}
+
+// keeps the order of the others
+void RunQueue::remove(uint16_t id) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (at(i).id == id) {
+            for (uint8_t j = i; j > 0; j--) {
+                at(j) = at(j - 1);
+            }
+            pop();
+            return;
+        }
+    }
+}
+
+void RunQueue::clear() {
+    _head = 0;
+    _count = 0;
+}
+
+uint8_t RunQueue::count() {
+    return _count;
+}
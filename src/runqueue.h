@@ -0,0 +1,42 @@
+#ifndef runqueue_h
+#define runqueue_h
+
+#include <Arduino.h>
+
+#define RUNS_MAX 8   // runs on course at once
+#define RUN_GATES 8  // split gates
+
+typedef struct Run {
+    uint16_t id;
+    int64_t startTime;          // [us] local clock
+    int64_t lastCrossingTime;   // [us] start or the last split gate crossed
+    uint8_t gate;               // last split gate crossed, 0 at the start
+    int32_t splits[RUN_GATES];  // [us] since the start, 0 when not passed
+} Run;
+
+/**
+ * Runs on course in the start order. Finish crossings belong to the oldest run, split gate
+ * crossings to the oldest run which did not pass the gate yet.
+ * Used by the state machine task only.
+ */
+class RunQueue {
+   public:
+    RunQueue();
+
+    Run *push(uint16_t id, int64_t startTime);
+    Run *front();
+    Run *findForGate(uint8_t gate);
+    void pop();
+    void remove(uint16_t id);
+    void clear();
+    uint8_t count();
+
+   private:
+    Run _runs[RUNS_MAX];
+    uint8_t _head;
+    uint8_t _count;
+
+    Run &at(uint8_t index);
+};
+
+#endif
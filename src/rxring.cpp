@@ -0,0 +1,56 @@
+#include "rxring.h"
+
+ReceiveRing::ReceiveRing() {
+    _head = 0;
+    _tail = 0;
+    _consumer = NULL;
+    _dropped = 0;
+    _invalid = 0;
+    _maxFill = 0;
+}
+
+void ReceiveRing::setConsumer(TaskHandle_t consumer) {
+    _consumer = consumer;
+}
+
+bool ReceiveRing::push(const uint8_t *address, const uint8_t *data, int len, int minLength, int64_t arrivalTime) {
+    if (len < minLength || len > ESP_NOW_MAX_DATA_LEN) {
+        _invalid++;
+        return false;
+    }
+    uint32_t head = _head;
+    uint32_t fill = head - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+    if (fill == RX_RING_SIZE) {
+        _dropped++;
+        return false;
+    }
+    _maxFill = max(_maxFill, fill + 1);
+
+    ReceivedFrame &frame = _frames[head % RX_RING_SIZE];
+    frame.arrivalTime = arrivalTime;
+    memcpy(frame.address, address, ESP_NOW_ETH_ALEN);
+    frame.length = len;
+    memcpy(frame.data, data, len);
+    __atomic_store_n(&_head, head + 1, __ATOMIC_RELEASE);
+
+    if (_consumer != NULL) {
+        xTaskNotifyGive(_consumer);
+    }
+    return true;
+}
+
+const ReceivedFrame *ReceiveRing::peek() {
+    uint32_t tail = _tail;
+    if (__atomic_load_n(&_head, __ATOMIC_ACQUIRE) == tail) {
+        return NULL;
+    }
+    return &_frames[tail % RX_RING_SIZE];
+}
+
+void ReceiveRing::release() {
+    __atomic_store_n(&_tail, _tail + 1, __ATOMIC_RELEASE);
+}
+
+void ReceiveRing::printStatistics(Print *output) {
+    output->printf("Receive ring: %u/%u max used, %u dropped (full), %u invalid size\r\n", _maxFill, RX_RING_SIZE, _dropped, _invalid);
+}
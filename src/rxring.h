@@ -0,0 +1,60 @@
+#ifndef rxring_h
+#define rxring_h
+
+#include <Arduino.h>
+#include <esp_now.h>
+
+#define RX_RING_SIZE 16  // frames, power of 2
+
+typedef struct ReceivedFrame {
+    int64_t arrivalTime;  // [us] stamped first thing in the receive callback
+    uint8_t address[ESP_NOW_ETH_ALEN];
+    uint8_t length;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+} ReceivedFrame;
+
+/**
+ * Received ESP-NOW frames on their way from the WiFi task to the receive task.
+ *
+ * Single producer (the receive callback) and single consumer ring, lock-free. The producer validates
+ * the size, copies the frame once (the driver reuses its buffer after the callback) and wakes the
+ * consumer by a direct task notification, it never blocks, formats or allocates. The consumer
+ * decodes the frame in place. Frames arriving to the full ring are dropped and counted.
+ */
+class ReceiveRing {
+   public:
+    ReceiveRing();
+
+    /**
+     * @brief The task notified when a frame arrives.
+     */
+    void setConsumer(TaskHandle_t consumer);
+
+    /**
+     * @brief Producer side, called from the receive callback.
+     *
+     * @param minLength [B] shortest valid frame
+     * @return false when the frame was rejected (size) or dropped (ring full)
+     */
+    bool push(const uint8_t *address, const uint8_t *data, int len, int minLength, int64_t arrivalTime);
+
+    /**
+     * @brief Consumer side - the oldest frame, stays in the ring until released. NULL when empty.
+     */
+    const ReceivedFrame *peek();
+    void release();
+
+    void printStatistics(Print *output);
+
+   private:
+    ReceivedFrame _frames[RX_RING_SIZE];
+    uint32_t _head;  // written by the producer only
+    uint32_t _tail;  // written by the consumer only
+    TaskHandle_t _consumer;
+
+    uint32_t _dropped;
+    uint32_t _invalid;
+    uint32_t _maxFill;
+};
+
+#endif
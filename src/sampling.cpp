@@ -0,0 +1,92 @@
+#include "sampling.h"
+
+#include "timebase.h"
+
+SamplingScheduler::SamplingScheduler() {
+    _critical = false;
+    _mode = SAMPLING_MODE_IDLE;
+    for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+        _lastDistance[i] = DISTANCE_TIMEOUT;
+    }
+    _stableSince = 0;
+    _fastUntil = 0;
+    memset(_rounds, 0, sizeof(_rounds));
+}
+
+void SamplingScheduler::setCritical(bool critical) {
+    _critical = critical;
+}
+
+// an echo appearing or getting closer in the range of the arrive threshold, a static one is the background
+bool SamplingScheduler::isApproaching(float distance, float lastDistance, float arriveThreshold) {
+    if (distance == DISTANCE_TIMEOUT || distance >= arriveThreshold * SAMPLING_APPROACH_FACTOR) {
+        return false;
+    }
+    return lastDistance == DISTANCE_TIMEOUT || distance < lastDistance * (1 - SAMPLING_STABLE_TOLERANCE);
+}
+
+bool SamplingScheduler::hasChanged(float distance, float lastDistance) {
+    if ((distance == DISTANCE_TIMEOUT) != (lastDistance == DISTANCE_TIMEOUT)) {
+        return true;
+    }
+    return distance != DISTANCE_TIMEOUT && fabs(distance - lastDistance) > lastDistance * SAMPLING_STABLE_TOLERANCE;
+}
+
+int64_t SamplingScheduler::next(bool measuring, Detector &detector, int64_t time) {
+    if (!measuring) {
+        _mode = SAMPLING_MODE_IDLE;
+        for (uint8_t i = 0; i < DETECTOR_SENSORS; i++) {
+            _lastDistance[i] = DISTANCE_TIMEOUT;
+        }
+        _stableSince = time;
+        _rounds[_mode]++;
+        return SAMPLING_IDLE;
+    }
+
+    bool approaching = false;
+    bool changed = false;
+    for (uint8_t i = 0; i < detector.getRoundSize(); i++) {
+        const DetectorSample &sample = detector.getRoundSample(i);
+        float &lastDistance = _lastDistance[sample.sensor];
+        approaching |= isApproaching(sample.distance, lastDistance, detector.getArriveThreshold(sample.sensor));
+        changed |= hasChanged(sample.distance, lastDistance);
+        lastDistance = sample.distance;
+    }
+    if (approaching) {
+        _fastUntil = time + SAMPLING_FAST_HOLD * MICROS_PER_MILLI;
+    }
+    if (changed) {
+        _stableSince = time;
+    }
+
+    if (_critical || time < _fastUntil) {
+        _mode = SAMPLING_MODE_FAST;
+    } else if (time - _stableSince >= SAMPLING_STABLE_TIME * MICROS_PER_MILLI) {
+        _mode = SAMPLING_MODE_SPARSE;
+    } else {
+        _mode = SAMPLING_MODE_NORMAL;
+    }
+    _rounds[_mode]++;
+
+    switch (_mode) {
+        case SAMPLING_MODE_FAST:
+            return SAMPLING_FAST_PERIOD;
+        case SAMPLING_MODE_SPARSE:
+            return SAMPLING_SPARSE_PERIOD;
+        default:
+            return SAMPLING_NORMAL_PERIOD;
+    }
+}
+
+SamplingMode SamplingScheduler::getMode() {
+    return _mode;
+}
+
+void SamplingScheduler::printStatistics(Print *output) {
+    output->printf("Sampling: %s now, rounds fast %u, normal %u, sparse %u, idle wakeups %u\r\n",
+                   _mode == SAMPLING_MODE_FAST     ? "fast"
+                   : _mode == SAMPLING_MODE_NORMAL ? "normal"
+                   : _mode == SAMPLING_MODE_SPARSE ? "sparse"
+                                                   : "idle",
+                   _rounds[SAMPLING_MODE_FAST], _rounds[SAMPLING_MODE_NORMAL], _rounds[SAMPLING_MODE_SPARSE], _rounds[SAMPLING_MODE_IDLE]);
+}
@@ -0,0 +1,70 @@
+#ifndef sampling_h
+#define sampling_h
+
+#include <Arduino.h>
+
+#include "detector.h"
+
+#define SAMPLING_IDLE -1                // next() - not measuring, wait until woken
+#define SAMPLING_FAST_PERIOD 2000       // [us] between rounds, the sensor guard keeps it crosstalk free
+#define SAMPLING_NORMAL_PERIOD 5000     // [us] scene not settled yet
+#define SAMPLING_SPARSE_PERIOD 50000    // [us] scene stable
+#define SAMPLING_IDLE_PERIOD 1000       // [ms] longest wait while not measuring
+#define SAMPLING_STABLE_TIME 2000       // [ms] no change for that long makes the scene stable
+#define SAMPLING_STABLE_TOLERANCE 0.1   // relative distance change still considered stable
+#define SAMPLING_APPROACH_FACTOR 1.5    // getting closer within that times the arrive threshold is an approach
+#define SAMPLING_FAST_HOLD 1000         // [ms] fast sampling kept after the last approach
+
+typedef enum {
+    SAMPLING_MODE_IDLE,
+    SAMPLING_MODE_SPARSE,
+    SAMPLING_MODE_NORMAL,
+    SAMPLING_MODE_FAST,
+    SAMPLING_MODES
+} SamplingMode;
+
+/**
+ * Adaptive cadence of the detector rounds.
+ *
+ * Fast whenever the state is timing critical (set by the state machine) or the distance trend of a
+ * sensor shows an approaching object - an echo appearing or getting closer near the arrive threshold in
+ * effect for that sensor (learned from its background or configured). A static surface inside that
+ * range (wall, tripod) is no approach. Sparse when the scene has not changed for SAMPLING_STABLE_TIME,
+ * normal in between.
+ * Nothing is triggered while the measurement is off. Sparse sampling saves the sensor bursts and lets
+ * the CPU sleep, fast sampling lowers the quantization of the crossing time.
+ */
+class SamplingScheduler {
+   public:
+    SamplingScheduler();
+
+    /**
+     * @brief Timing critical state entered/left, fast sampling takes effect with the next round.
+     */
+    void setCritical(bool critical);
+
+    /**
+     * @brief Decides the cadence after a round.
+     *
+     * @param measuring the detector is measuring (rounds are taken)
+     * @param detector the samples of the round and the arrive thresholds of the sensors
+     * @return delay until the next round [us] or SAMPLING_IDLE
+     */
+    int64_t next(bool measuring, Detector &detector, int64_t time);
+
+    SamplingMode getMode();
+    void printStatistics(Print *output);
+
+   private:
+    volatile bool _critical;
+    SamplingMode _mode;
+    float _lastDistance[DETECTOR_SENSORS];  // [cm] per sensor
+    int64_t _stableSince;  // [us]
+    int64_t _fastUntil;    // [us]
+    uint32_t _rounds[SAMPLING_MODES];
+
+    bool isApproaching(float distance, float lastDistance, float arriveThreshold);
+    bool hasChanged(float distance, float lastDistance);
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "scheduler.h"
+
+#include "timebase.h"
+
+Scheduler::Scheduler() {
+    _jobCount = 0;
+    _task = NULL;
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+    _wakeups = 0;
+}
+
+int8_t Scheduler::addJob(const char *name, JobFunction function, int64_t delay) {
+    if (_jobCount == SCHEDULER_MAX_JOBS) {
+        return -1;
+    }
+    portENTER_CRITICAL(&_lock);
+    uint8_t jobId = _jobCount++;
+    _jobs[jobId].name = name;
+    _jobs[jobId].function = function;
+    _jobs[jobId].deadline = delay == SCHEDULER_IDLE ? INT64_MAX : nowMicros() + delay;
+    _heap[jobId] = jobId;
+    _heapPosition[jobId] = jobId;
+    siftUp(jobId);
+    portEXIT_CRITICAL(&_lock);
+    if (_task != NULL) {
+        xTaskNotifyGive(_task);
+    }
+    return jobId;
+}
+
+void Scheduler::trigger(int8_t jobId) {
+    if (jobId < 0 || jobId >= _jobCount) {
+        return;
+    }
+    portENTER_CRITICAL(&_lock);
+    setDeadline(jobId, 0);
+    portEXIT_CRITICAL(&_lock);
+    if (_task != NULL) {
+        xTaskNotifyGive(_task);
+    }
+}
+
+void Scheduler::run() {
+    _task = xTaskGetCurrentTaskHandle();
+    while (1) {
+        portENTER_CRITICAL(&_lock);
+        int64_t deadline = _jobCount > 0 ? _jobs[_heap[0]].deadline : INT64_MAX;
+        portEXIT_CRITICAL(&_lock);
+
+        int64_t now = nowMicros();
+        if (deadline > now) {
+            TickType_t ticks = portMAX_DELAY;
+            if (deadline != INT64_MAX) {
+                // round up, waking a tick early would only spin through the loop once more
+                ticks = (TickType_t)((deadline - now + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000));
+            }
+            ulTaskNotifyTake(pdTRUE, ticks);
+            _wakeups++;
+            continue;
+        }
+
+        portENTER_CRITICAL(&_lock);
+        uint8_t jobId = _heap[0];
+        setDeadline(jobId, INT64_MAX);  // a trigger while running schedules it again
+        portEXIT_CRITICAL(&_lock);
+
+        int64_t delay = _jobs[jobId].function();
+
+        if (delay != SCHEDULER_IDLE) {
+            portENTER_CRITICAL(&_lock);
+            setDeadline(jobId, min(_jobs[jobId].deadline, nowMicros() + delay));
+            portEXIT_CRITICAL(&_lock);
+        }
+    }
+}
+
+uint32_t Scheduler::getWakeups() {
+    return _wakeups;
+}
+
+void Scheduler::setDeadline(uint8_t jobId, int64_t deadline) {
+    int64_t previous = _jobs[jobId].deadline;
+    _jobs[jobId].deadline = deadline;
+    if (deadline < previous) {
+        siftUp(_heapPosition[jobId]);
+    } else {
+        siftDown(_heapPosition[jobId]);
+    }
+}
+
+void Scheduler::siftUp(uint8_t position) {
+    while (position > 0) {
+        uint8_t parent = (position - 1) / 2;
+        if (_jobs[_heap[parent]].deadline <= _jobs[_heap[position]].deadline) {
+            break;
+        }
+        swap(parent, position);
+        position = parent;
+    }
+}
+
+void Scheduler::siftDown(uint8_t position) {
+    while (1) {
+        uint8_t smallest = position;
+        uint8_t left = 2 * position + 1;
+        uint8_t right = left + 1;
+        if (left < _jobCount && _jobs[_heap[left]].deadline < _jobs[_heap[smallest]].deadline) {
+            smallest = left;
+        }
+        if (right < _jobCount && _jobs[_heap[right]].deadline < _jobs[_heap[smallest]].deadline) {
+            smallest = right;
+        }
+        if (smallest == position) {
+            break;
+        }
+        swap(position, smallest);
+        position = smallest;
+    }
+}
+
+void Scheduler::swap(uint8_t a, uint8_t b) {
+    uint8_t jobA = _heap[a];
+    _heap[a] = _heap[b];
+    _heap[b] = jobA;
+    _heapPosition[_heap[a]] = a;
+    _heapPosition[_heap[b]] = b;
+}
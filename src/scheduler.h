@@ -0,0 +1,64 @@
+#ifndef scheduler_h
+#define scheduler_h
+
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_JOBS 12
+#define SCHEDULER_IDLE -1  // job return value - run again only when triggered
+
+/**
+ * Job callback, returns the delay [us] until the next run or SCHEDULER_IDLE.
+ */
+typedef int64_t (*JobFunction)();
+
+typedef struct Job {
+    const char *name;
+    JobFunction function;
+    int64_t deadline;  // [us] absolute, INT64_MAX when idle
+} Job;
+
+/**
+ * Deadline scheduler running the housekeeping jobs in a single task.
+ *
+ * Jobs are kept in a min-heap ordered by their deadlines, the task sleeps until the earliest one
+ * or until a job is triggered from elsewhere.
+ */
+class Scheduler {
+   public:
+    Scheduler();
+
+    /**
+     * @brief Adds a job, it runs for the first time after the given delay [us].
+     *
+     * @return job id used by trigger()
+     */
+    int8_t addJob(const char *name, JobFunction function, int64_t delay);
+
+    /**
+     * @brief Runs the job as soon as possible, can be called from any task.
+     */
+    void trigger(int8_t jobId);
+
+    /**
+     * @brief Scheduler task body, never returns.
+     */
+    void run();
+
+    uint32_t getWakeups();
+
+   private:
+    Job _jobs[SCHEDULER_MAX_JOBS];
+    uint8_t _heap[SCHEDULER_MAX_JOBS];      // job ids, heap ordered by deadline
+    uint8_t _heapPosition[SCHEDULER_MAX_JOBS];
+    uint8_t _jobCount;
+    TaskHandle_t _task;
+    portMUX_TYPE _lock;
+    uint32_t _wakeups;
+
+    void setDeadline(uint8_t jobId, int64_t deadline);
+    void siftUp(uint8_t position);
+    void siftDown(uint8_t position);
+    void swap(uint8_t a, uint8_t b);
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "statemachine.h"
+
+#include "logging.h"
+#include "timebase.h"
+
+StateMachine::StateMachine() {
+    _states = NULL;
+    _stateCount = 0;
+    _transitions = NULL;
+    _transitionCount = 0;
+    _queue = NULL;
+    _state = STATE_ANY;
+    _stateChangeTime = 0;
+    _timer = NULL;
+    _stateChangeCallback = NULL;
+}
+
+void StateMachine::init(const StateDefinition *states, uint8_t stateCount, const Transition *transitions, uint8_t transitionCount,
+                        QueueHandle_t queue) {
+    _states = states;
+    _stateCount = stateCount;
+    _transitions = transitions;
+    _transitionCount = transitionCount;
+    _queue = queue;
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onTimer;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "SM deadline";
+    if (esp_timer_create(&timerArgs, &_timer) != ESP_OK) {
+        Log.errorln("Cannot create the state machine timer");
+    }
+}
+
+void StateMachine::start(uint8_t state) {
+    enter(state);
+}
+
+// runs in the esp_timer task, exactly once per armed deadline
+void StateMachine::onTimer(void *arg) {
+    StateMachine *stateMachine = (StateMachine *)arg;
+    Message message;
+    message.event = stateMachine->_timerEvent;
+    message.time = nowMicros();
+    if (xQueueSend(stateMachine->_queue, &message, 0) != pdTRUE) {
+        DLog.errorln("Problem while putting a deadline event to a state machine queue, is it full?");
+    }
+}
+
+const StateDefinition *StateMachine::findState(uint8_t state) {
+    for (uint8_t i = 0; i < _stateCount; i++) {
+        if (_states[i].state == state) {
+            return &_states[i];
+        }
+    }
+    return NULL;
+}
+
+void StateMachine::enter(uint8_t state) {
+    _state = state;
+    _stateChangeTime = nowMicros();
+    if (_stateChangeCallback != NULL) {
+        _stateChangeCallback(state);
+    }
+    const StateDefinition *definition = findState(state);
+    if (definition == NULL) {
+        return;
+    }
+    if (definition->entry != NULL) {
+        definition->entry();
+    }
+    if (definition->deadline != NULL && _timer != NULL) {
+        _timerEvent = definition->deadlineEvent;
+        int64_t delay = definition->deadline() - nowMicros();
+        esp_timer_start_once(_timer, max(delay, (int64_t)0));
+    }
+}
+
+void StateMachine::leave() {
+    if (_timer != NULL) {
+        esp_timer_stop(_timer);  // fails harmlessly when not armed
+    }
+    const StateDefinition *definition = findState(_state);
+    if (definition != NULL && definition->exit != NULL) {
+        definition->exit();
+    }
+}
+
+bool StateMachine::dispatch(Message &message) {
+    for (uint8_t i = 0; i < _transitionCount; i++) {
+        const Transition &transition = _transitions[i];
+        if ((transition.state != _state && transition.state != STATE_ANY) || transition.event != message.event) {
+            continue;
+        }
+        if (transition.guard != NULL && !transition.guard(message)) {
+            continue;
+        }
+        if (transition.nextState == STATE_SAME) {
+            if (transition.action != NULL) {
+                transition.action(message);
+            }
+        } else {
+            leave();
+            if (transition.action != NULL) {
+                transition.action(message);
+            }
+            enter(transition.nextState);
+        }
+        return true;
+    }
+    return false;
+}
+
+void StateMachine::setStateChangeCallback(StateChangeCallback callback) {
+    _stateChangeCallback = callback;
+}
+
+uint8_t StateMachine::getState() {
+    return _state;
+}
+
+int64_t StateMachine::getStateChangeTime() {
+    return _stateChangeTime;
+}
@@ -0,0 +1,88 @@
+#ifndef statemachine_h
+#define statemachine_h
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "message.h"
+
+#define STATE_ANY 0xff   // Transition.state matching every state
+#define STATE_SAME 0xfe  // Transition.nextState of an internal transition, no exit/entry actions
+
+typedef void (*StateAction)();
+typedef void (*TransitionAction)(Message &message);
+typedef bool (*TransitionGuard)(Message &message);
+typedef int64_t (*StateDeadline)();
+typedef void (*StateChangeCallback)(uint8_t state);
+
+/**
+ * State with its entry/exit actions. When deadline is set, a one-shot timer posting
+ * deadlineEvent at the returned absolute time [us] is armed on entry and stopped on exit.
+ */
+typedef struct StateDefinition {
+    uint8_t state;
+    StateAction entry;
+    StateAction exit;
+    Event deadlineEvent;
+    StateDeadline deadline;
+} StateDefinition;
+
+/**
+ * Transition taken when the event arrives in the state and the guard (if any) passes.
+ * The first matching row of the table wins.
+ */
+typedef struct Transition {
+    uint8_t state;
+    Event event;
+    TransitionGuard guard;
+    TransitionAction action;
+    uint8_t nextState;
+} Transition;
+
+/**
+ * Table driven state machine, events are read from the queue by the owning task.
+ */
+class StateMachine {
+   public:
+    StateMachine();
+
+    void init(const StateDefinition *states, uint8_t stateCount, const Transition *transitions, uint8_t transitionCount, QueueHandle_t queue);
+
+    /**
+     * @brief Enters the initial state (runs its entry action).
+     */
+    void start(uint8_t state);
+
+    /**
+     * @brief Processes the event, returns false when no transition matched.
+     */
+    bool dispatch(Message &message);
+
+    /**
+     * @brief Called with the new state before its entry action runs.
+     */
+    void setStateChangeCallback(StateChangeCallback callback);
+
+    uint8_t getState();
+    int64_t getStateChangeTime();
+
+   private:
+    const StateDefinition *_states;
+    uint8_t _stateCount;
+    const Transition *_transitions;
+    uint8_t _transitionCount;
+    QueueHandle_t _queue;
+
+    volatile uint8_t _state;
+    int64_t _stateChangeTime;
+    esp_timer_handle_t _timer;
+    Event _timerEvent;
+    StateChangeCallback _stateChangeCallback;
+
+    const StateDefinition *findState(uint8_t state);
+    void enter(uint8_t state);
+    void leave();
+    static void onTimer(void *arg);
+};
+
+#endif
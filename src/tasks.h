@@ -0,0 +1,115 @@
+#ifndef tasks_h
+#define tasks_h
+
+/**
+ * Core and priority layout of the tasks, every value can be overridden by a build flag.
+ *
+ * The sampling core runs the detector task only - trigger, echo ISR (attached by the detector task,
+ * so it lands on the same core) and the classification of the window. Radio (WiFi stack, receive
+ * and communication tasks), state machine, UI (display, LED, button via the scheduler), logging,
+ * results journal and export share the system core. The UART ISR stays on the core running setup().
+ * Check a layout with the jitter serial command, see jitter.h.
+ *
+ * Stacks [B] and queues are allocated statically from this plan, see memory.h. Size a stack from the
+ * peak the memory serial command reports, with a margin for the paths not exercised yet.
+ */
+
+#ifndef SAMPLING_CORE
+#define SAMPLING_CORE 1  // APP_CPU
+#endif
+#ifndef SYSTEM_CORE
+#define SYSTEM_CORE 0  // PRO_CPU, the WiFi driver lives here
+#endif
+
+#ifndef TASK_DETECTOR_CORE
+#define TASK_DETECTOR_CORE SAMPLING_CORE
+#endif
+#ifndef TASK_DETECTOR_PRIORITY
+#define TASK_DETECTOR_PRIORITY 6
+#endif
+#ifndef TASK_DETECTOR_STACK
+#define TASK_DETECTOR_STACK 4096
+#endif
+
+#ifndef TASK_RECEIVE_CORE
+#define TASK_RECEIVE_CORE SYSTEM_CORE
+#endif
+#ifndef TASK_RECEIVE_PRIORITY
+#define TASK_RECEIVE_PRIORITY 5
+#endif
+#ifndef TASK_RECEIVE_STACK
+#define TASK_RECEIVE_STACK 4096
+#endif
+
+#ifndef TASK_COMMUNICATION_CORE
+#define TASK_COMMUNICATION_CORE SYSTEM_CORE
+#endif
+#ifndef TASK_COMMUNICATION_PRIORITY
+#define TASK_COMMUNICATION_PRIORITY 4
+#endif
+#ifndef TASK_COMMUNICATION_STACK
+#define TASK_COMMUNICATION_STACK 6144  // retransmission keeps the pending frames on the stack
+#endif
+
+#ifndef TASK_STATE_MACHINE_CORE
+#define TASK_STATE_MACHINE_CORE SYSTEM_CORE
+#endif
+#ifndef TASK_STATE_MACHINE_PRIORITY
+#define TASK_STATE_MACHINE_PRIORITY 3  // ahead of the UI jobs
+#endif
+#ifndef TASK_STATE_MACHINE_STACK
+#define TASK_STATE_MACHINE_STACK 4096
+#endif
+
+#ifndef TASK_SCHEDULER_CORE
+#define TASK_SCHEDULER_CORE SYSTEM_CORE
+#endif
+#ifndef TASK_SCHEDULER_PRIORITY
+#define TASK_SCHEDULER_PRIORITY 2
+#endif
+#ifndef TASK_SCHEDULER_STACK
+#define TASK_SCHEDULER_STACK 6144  // serial commands and reports
+#endif
+
+#ifndef TASK_EXPORT_CORE
+#define TASK_EXPORT_CORE SYSTEM_CORE
+#endif
+#ifndef TASK_EXPORT_PRIORITY
+#define TASK_EXPORT_PRIORITY 1
+#endif
+#ifndef TASK_EXPORT_STACK
+#define TASK_EXPORT_STACK 4096
+#endif
+
+#ifndef TASK_JOURNAL_CORE
+#define TASK_JOURNAL_CORE SYSTEM_CORE
+#endif
+#ifndef TASK_JOURNAL_PRIORITY
+#define TASK_JOURNAL_PRIORITY 1  // flash erase, below the scheduler (display)
+#endif
+#ifndef TASK_JOURNAL_STACK
+#define TASK_JOURNAL_STACK 3072
+#endif
+
+#ifndef TASK_JITTER_LOAD_STACK
+#define TASK_JITTER_LOAD_STACK 2048  // each of the JITTER_LOAD_TASKS, core and priorities come with the benchmark
+#endif
+
+#ifndef TASK_LOG_CORE
+#define TASK_LOG_CORE SYSTEM_CORE
+#endif
+#ifndef TASK_LOG_PRIORITY
+#define TASK_LOG_PRIORITY 1
+#endif
+#ifndef TASK_LOG_STACK
+#define TASK_LOG_STACK 3072
+#endif
+
+#ifndef SEND_QUEUE_LENGTH
+#define SEND_QUEUE_LENGTH 10  // messages
+#endif
+#ifndef STATE_MACHINE_QUEUE_LENGTH
+#define STATE_MACHINE_QUEUE_LENGTH 10  // messages
+#endif
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef timebase_h
+#define timebase_h
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#define MICROS_PER_MILLI 1000
+
+/**
+ * @brief Monotonic time since boot in microseconds.
+ *
+ * The single timebase of the timing pipeline - detector samples, state machines,
+ * messages and the display all use it. Conversion to milliseconds happens only
+ * when a value is shown.
+ */
+inline int64_t nowMicros() {
+    return esp_timer_get_time();
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "tracer.h"
+
+#include "timebase.h"
+
+LatencyTracer::LatencyTracer() {
+    _toReferenceTime = NULL;
+    _nextTrace = 0;
+    _inFlightCount = 0;
+    _nextTicket = 0;
+    _displayTrace = TRACE_NONE;
+    _displayOrigin = 0;
+    _lock = portMUX_INITIALIZER_UNLOCKED;
+    reset();
+}
+
+void LatencyTracer::setClock(int64_t (*toReferenceTime)(int64_t localTime)) {
+    _toReferenceTime = toReferenceTime;
+}
+
+uint16_t LatencyTracer::begin(TracePath path) {
+    portENTER_CRITICAL(&_lock);
+    _nextTrace = (_nextTrace + 1) & ~TRACE_PATH_FINISH;
+    if (_nextTrace == TRACE_NONE) {
+        _nextTrace = 1;
+    }
+    uint16_t trace = _nextTrace | (path == TRACE_PATH_FINISH_CROSSING ? TRACE_PATH_FINISH : 0);
+    _traces[path]++;
+    portEXIT_CRITICAL(&_lock);
+    return trace;
+}
+
+void LatencyTracer::mark(const Message &message, TraceStage stage, int64_t localTime) {
+    if (message.trace == TRACE_NONE) {
+        return;
+    }
+    add(message.trace, message.traceOrigin, stage, localTime);
+    if (stage == TRACE_DISPLAY) {
+        portENTER_CRITICAL(&_lock);
+        _displayTrace = message.trace;
+        _displayOrigin = message.traceOrigin;
+        portEXIT_CRITICAL(&_lock);
+    }
+}
+
+void LatencyTracer::mark(const Message &message, TraceStage stage) {
+    mark(message, stage, nowMicros());
+}
+
+uint8_t LatencyTracer::onTransmit(const Message *message) {
+    portENTER_CRITICAL(&_lock);
+    if (_inFlightCount == TRACE_IN_FLIGHT) {  // a callback got lost, forget the oldest
+        memmove(_inFlight, _inFlight + 1, (TRACE_IN_FLIGHT - 1) * sizeof(TraceInFlight));
+        _inFlightCount--;
+    }
+    TraceInFlight &frame = _inFlight[_inFlightCount++];
+    frame.ticket = _nextTicket++;
+    frame.trace = message != NULL ? message->trace : TRACE_NONE;
+    frame.origin = message != NULL ? message->traceOrigin : 0;
+    uint8_t ticket = frame.ticket;
+    portEXIT_CRITICAL(&_lock);
+    return ticket;
+}
+
+void LatencyTracer::cancel(uint8_t ticket) {
+    portENTER_CRITICAL(&_lock);
+    for (uint8_t i = 0; i < _inFlightCount; i++) {
+        if (_inFlight[i].ticket == ticket) {
+            memmove(_inFlight + i, _inFlight + i + 1, (_inFlightCount - i - 1) * sizeof(TraceInFlight));
+            _inFlightCount--;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+void LatencyTracer::onSendDone() {
+    int64_t now = nowMicros();
+    TraceInFlight frame = {0, TRACE_NONE, 0};
+    portENTER_CRITICAL(&_lock);
+    if (_inFlightCount > 0) {
+        frame = _inFlight[0];
+        memmove(_inFlight, _inFlight + 1, (_inFlightCount - 1) * sizeof(TraceInFlight));
+        _inFlightCount--;
+    }
+    portEXIT_CRITICAL(&_lock);
+    if (frame.trace != TRACE_NONE) {
+        add(frame.trace, frame.origin, TRACE_SENT, now);
+    }
+}
+
+void LatencyTracer::onRendered() {
+    int64_t now = nowMicros();
+    portENTER_CRITICAL(&_lock);
+    uint16_t trace = _displayTrace;
+    int64_t origin = _displayOrigin;
+    _displayTrace = TRACE_NONE;
+    portEXIT_CRITICAL(&_lock);
+    if (trace != TRACE_NONE) {
+        add(trace, origin, TRACE_RENDERED, now);
+    }
+}
+
+void LatencyTracer::add(uint16_t trace, int64_t origin, TraceStage stage, int64_t localTime) {
+    int64_t time = _toReferenceTime != NULL ? _toReferenceTime(localTime) : localTime;
+    int64_t latency = max(time - origin, (int64_t)0);  // clock estimate error
+    StageHistogram &histogram = _stages[(trace & TRACE_PATH_FINISH) ? TRACE_PATH_FINISH_CROSSING : TRACE_PATH_START_CROSSING][stage];
+    portENTER_CRITICAL(&_lock);
+    histogram.count++;
+    histogram.min = min(histogram.min, latency);
+    histogram.max = max(histogram.max, latency);
+    histogram.sum += latency;
+    histogram.buckets[min((int64_t)TRACE_BUCKETS - 1, latency / TRACE_BUCKET_WIDTH)]++;
+    portEXIT_CRITICAL(&_lock);
+}
+
+void LatencyTracer::reset() {
+    portENTER_CRITICAL(&_lock);
+    memset(_traces, 0, sizeof(_traces));
+    memset(_stages, 0, sizeof(_stages));
+    for (uint8_t path = 0; path < TRACE_PATHS; path++) {
+        for (uint8_t stage = 0; stage < TRACE_STAGES; stage++) {
+            _stages[path][stage].min = INT64_MAX;
+        }
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+// upper bound of the bucket containing the given percentile
+int64_t LatencyTracer::percentile(const StageHistogram &histogram, uint8_t prct) {
+    uint32_t threshold = (histogram.count * prct + 99) / 100;
+    uint32_t cumulative = 0;
+    for (int i = 0; i < TRACE_BUCKETS; i++) {
+        cumulative += histogram.buckets[i];
+        if (cumulative >= threshold) {
+            return min((int64_t)(i + 1) * TRACE_BUCKET_WIDTH, histogram.max);
+        }
+    }
+    return histogram.max;
+}
+
+const char *LatencyTracer::stageName(TraceStage stage) {
+    static char const *stageNames[TRACE_STAGES] = {"echo", "detected", "queued",   "dispatched", "send queued",
+                                                   "send", "sent",     "received", "display",    "rendered"};
+    if (stage >= 0 && stage < TRACE_STAGES) {
+        return stageNames[stage];
+    }
+    return "UNDEFINED";
+}
+
+void LatencyTracer::print(Print *output) {
+    static char const *pathNames[TRACE_PATHS] = {"start crossing", "finish/split crossing"};
+    StageHistogram histogram;  // a copy, the stages keep being recorded
+    for (uint8_t path = 0; path < TRACE_PATHS; path++) {
+        output->printf("Latency since the %s, %u traces started here [us]:\r\n", pathNames[path], _traces[path]);
+        output->printf("  %-11s %6s %8s %8s %8s %8s %8s\r\n", "stage", "count", "min", "mean", "p50 <", "p99 <", "max");
+        for (uint8_t stage = 0; stage < TRACE_STAGES; stage++) {
+            portENTER_CRITICAL(&_lock);
+            histogram = _stages[path][stage];
+            portEXIT_CRITICAL(&_lock);
+            if (histogram.count == 0) {
+                continue;
+            }
+            output->printf("  %-11s %6u %8lld %8lld %8lld %8lld %8lld\r\n", stageName((TraceStage)stage), histogram.count, histogram.min,
+                           histogram.sum / histogram.count, percentile(histogram, 50), percentile(histogram, 99), histogram.max);
+        }
+    }
+}
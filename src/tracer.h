@@ -0,0 +1,129 @@
+#ifndef tracer_h
+#define tracer_h
+
+#include <Arduino.h>
+
+#include "message.h"
+
+#define TRACE_BUCKET_WIDTH 1000   // [us] histogram resolution
+#define TRACE_BUCKETS 50          // last bucket collects everything above
+#define TRACE_IN_FLIGHT 8         // frames handed to esp_now_send waiting for their send callback
+#define TRACE_NONE 0              // Message.trace of the untraced messages
+#define TRACE_PATH_FINISH 0x8000  // trace id flag - finish or split crossing, start crossing otherwise
+
+/**
+ * Stages of a crossing on its way to the display, in the order it passes them.
+ */
+typedef enum {
+    TRACE_ECHO,        // falling edge of the echo that completed the detection
+    TRACE_DETECTED,    // Detector::read returned
+    TRACE_QUEUED,      // addStateMachineQueue
+    TRACE_DISPATCHED,  // taken from the queue by the state machine task
+    TRACE_SEND_QUEUED, // addSendQueue, a gate crossing goes to both queues
+    TRACE_SEND,        // esp_now_send called (again for every retransmission)
+    TRACE_SENT,        // send callback
+    TRACE_RECEIVED,    // frame arrival at the peer (receive callback)
+    TRACE_DISPLAY,     // Display::showTime / showTimeContinuously
+    TRACE_RENDERED,    // digits sent to the display
+    TRACE_STAGES
+} TraceStage;
+
+typedef enum {
+    TRACE_PATH_START_CROSSING,
+    TRACE_PATH_FINISH_CROSSING,
+    TRACE_PATHS
+} TracePath;
+
+typedef struct StageHistogram {
+    uint32_t count;
+    int64_t min;  // [us]
+    int64_t max;  // [us]
+    int64_t sum;  // [us]
+    uint32_t buckets[TRACE_BUCKETS];
+} StageHistogram;
+
+typedef struct TraceInFlight {
+    uint8_t ticket;
+    uint16_t trace;
+    int64_t origin;
+} TraceInFlight;
+
+/**
+ * End-to-end latency of the crossings, per stage.
+ *
+ * A crossing gets a correlation id (Message.trace) when it is detected, the id and the crossing time
+ * (Message.traceOrigin, start device clock) travel with every message derived from it, including the
+ * radio hop. Each stage stamps esp_timer, converts the stamp to the start device clock and adds the
+ * time elapsed since the crossing to the histogram of the stage. The histograms are kept per device,
+ * so each device reports the stages it has seen; the differences between the stages show where the
+ * time goes.
+ */
+class LatencyTracer {
+   public:
+    LatencyTracer();
+
+    /**
+     * @brief Conversion of the local timestamps to the start device clock, identity when not set.
+     */
+    void setClock(int64_t (*toReferenceTime)(int64_t localTime));
+
+    /**
+     * @brief Starts the trace of a crossing, the crossing time goes to Message.traceOrigin.
+     *
+     * @return correlation id to be stored to Message.trace
+     */
+    uint16_t begin(TracePath path);
+
+    /**
+     * @brief Records the stage of the traced message, untraced messages are ignored.
+     *
+     * @param localTime [us] local timestamp of the stage
+     */
+    void mark(const Message &message, TraceStage stage, int64_t localTime);
+    void mark(const Message &message, TraceStage stage);
+
+    /**
+     * @brief A frame is going to be handed to esp_now_send, every call (traced or not, ACKs included)
+     * must be reported as the send callback does not tell which frame it belongs to.
+     * ESP-NOW reports the send results in the order of the esp_now_send calls.
+     *
+     * @return ticket for cancel() when esp_now_send fails (no callback comes then)
+     */
+    uint8_t onTransmit(const Message *message);
+    void cancel(uint8_t ticket);
+
+    /**
+     * @brief Send callback, the oldest frame in flight reached TRACE_SENT.
+     */
+    void onSendDone();
+
+    /**
+     * @brief Display job rendered the content, the pending TRACE_DISPLAY trace reached TRACE_RENDERED.
+     */
+    void onRendered();
+
+    void reset();
+    void print(Print *output);
+
+    static const char *stageName(TraceStage stage);
+
+   private:
+    int64_t (*_toReferenceTime)(int64_t localTime);
+    uint16_t _nextTrace;
+    uint32_t _traces[TRACE_PATHS];
+    StageHistogram _stages[TRACE_PATHS][TRACE_STAGES];
+
+    TraceInFlight _inFlight[TRACE_IN_FLIGHT];  // oldest first
+    uint8_t _inFlightCount;
+    uint8_t _nextTicket;
+
+    uint16_t _displayTrace;  // waiting for the display job
+    int64_t _displayOrigin;
+
+    portMUX_TYPE _lock;
+
+    void add(uint16_t trace, int64_t origin, TraceStage stage, int64_t localTime);
+    int64_t percentile(const StageHistogram &histogram, uint8_t prct);
+};
+
+#endif
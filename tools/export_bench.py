@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""Export throughput benchmark on Linux.
+
+Streams synthetic export frames (results and trace chunks like the firmware sends) through a PTY pair,
+or through a real serial port with TX and RX bridged (--device), and decodes them on the other end.
+Reports the throughput, CRC errors and lost frames. A PTY does not emulate the baud rate, it measures
+the host side (parser) limit; use a bridged USB-UART to verify the wire speed.
+
+    export_bench.py --megabytes 20
+    export_bench.py --device /dev/ttyUSB0 --baud 2000000 --megabytes 2
+"""
+
+import argparse
+import os
+import pty
+import termios
+import threading
+import time
+import tty
+
+import export_protocol as protocol
+
+CHUNK = 1024  # EXPORT_CHUNK
+
+
+def synthetic_frames(total_bytes):
+    sequence = 0
+    sent = 0
+    yield protocol.encode_frame(protocol.FRAME_HELLO, sequence, protocol.HELLO.pack(0x07, protocol.RESULT.size, 0))
+    trace = bytes(range(256)) * (CHUNK // 256)
+    while sent < total_bytes:
+        sequence += 1
+        if sequence % 16 == 0:
+            splits = [sequence * 1000 + i for i in range(protocol.JOURNAL_SPLITS)]
+            payload = protocol.RESULT.pack(sequence, 1, sequence, sequence * 10, sequence * 100, *splits, 0, b"\xff" * 7, 0)
+            frame = protocol.encode_frame(protocol.FRAME_RESULT, sequence, payload)
+        else:
+            frame = protocol.encode_frame(protocol.FRAME_TRACE, sequence, trace)
+        sent += len(frame)
+        yield frame
+    sequence += 1
+    yield protocol.encode_frame(protocol.FRAME_END, sequence, protocol.END.pack(sequence + 1, 0, 0))
+
+
+def configure(fd, baud):
+    tty.setraw(fd)
+    if baud:
+        attributes = termios.tcgetattr(fd)
+        speed = getattr(termios, "B%d" % baud)
+        attributes[4] = attributes[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attributes)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--megabytes", type=float, default=10)
+    parser.add_argument("--device", help="serial port with TX and RX bridged, PTY pair by default")
+    parser.add_argument("--baud", type=int, default=0)
+    args = parser.parse_args()
+
+    if args.device:
+        writer = reader = os.open(args.device, os.O_RDWR | os.O_NOCTTY)
+        configure(reader, args.baud)
+    else:
+        reader, slave = pty.openpty()
+        configure(slave, 0)
+        configure(reader, 0)
+        writer = slave
+
+    total = int(args.megabytes * 1024 * 1024)
+
+    def produce():
+        for frame in synthetic_frames(total):
+            view = memoryview(frame)
+            while view:
+                view = view[os.write(writer, view) :]
+
+    frames_parser = protocol.FrameParser()
+    received = 0
+    frames = 0
+    lost = 0
+    expected = None
+    finished = False
+    start = time.monotonic()
+    producer = threading.Thread(target=produce, daemon=True)
+    producer.start()
+    while not finished:
+        data = os.read(reader, 65536)
+        received += len(data)
+        for frame_type, sequence, _ in frames_parser.feed(data):
+            frames += 1
+            if expected is not None and sequence != expected:
+                lost += (sequence - expected) & 0xFFFF
+            expected = (sequence + 1) & 0xFFFF
+            finished = frame_type == protocol.FRAME_END
+    elapsed = time.monotonic() - start
+
+    print("%.1f MB in %.2f s: %.2f MB/s (%.0f kbaud equivalent), %d frames, %d lost, %d CRC errors"
+          % (received / 1e6, elapsed, received / 1e6 / elapsed, received * 10 / elapsed / 1000, frames, lost, frames_parser.crc_errors))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Decodes the binary export of the timer (serial command "export") into CSV or JSON.
+
+Capture the stream first, e.g. on Linux (the device answers "EXPORT <baud>" and switches the speed):
+    stty -F /dev/ttyUSB0 2000000 raw && cat /dev/ttyUSB0 > export.bin
+then
+    export_decode.py export.bin --results results.csv --traces traces.csv
+    export_decode.py export.bin --format json > export.json
+"""
+
+import argparse
+import csv
+import json
+import sys
+
+import export_protocol as protocol
+
+
+def decode(data):
+    parser = protocol.FrameParser()
+    results = []
+    trace_stream = bytearray()
+    end = None
+    expected_sequence = None
+    lost = 0
+    for frame_type, sequence, payload in parser.feed(data):
+        if expected_sequence is not None and sequence != expected_sequence:
+            lost += (sequence - expected_sequence) & 0xFFFF
+        expected_sequence = (sequence + 1) & 0xFFFF
+        if frame_type == protocol.FRAME_HELLO:
+            results, trace_stream, lost = [], bytearray(), 0  # a new export, keep the last one only
+        elif frame_type == protocol.FRAME_RESULT:
+            results.append(protocol.decode_result(payload))
+        elif frame_type == protocol.FRAME_TRACE:
+            trace_stream += payload
+        elif frame_type == protocol.FRAME_END:
+            end = dict(zip(("frames", "results", "trace_bytes"), protocol.END.unpack(payload)))
+    samples = protocol.decode_traces(bytes(trace_stream)) if lost == 0 else []
+    stats = {"crc_errors": parser.crc_errors, "lost_frames": lost, "skipped_bytes": parser.skipped, "end": end}
+    return results, samples, stats
+
+
+def write_csv(rows, fields, output):
+    writer = csv.DictWriter(output, fieldnames=fields, extrasaction="ignore")
+    writer.writeheader()
+    writer.writerows(rows)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="captured stream, - for stdin")
+    parser.add_argument("--format", choices=("csv", "json"), default="csv")
+    parser.add_argument("--results", help="results output file (CSV), stdout by default")
+    parser.add_argument("--traces", help="trace samples output file (CSV)")
+    args = parser.parse_args()
+
+    data = sys.stdin.buffer.read() if args.input == "-" else open(args.input, "rb").read()
+    results, samples, stats = decode(data)
+    print("results %d, samples %d, %s" % (len(results), len(samples), stats), file=sys.stderr)
+    if stats["lost_frames"]:
+        print("frames lost, traces not decoded", file=sys.stderr)
+
+    if args.format == "json":
+        json.dump({"results": results, "traces": samples, "stats": stats}, sys.stdout, indent=1)
+        return
+    if args.results:
+        with open(args.results, "w", newline="") as output:
+            write_csv(results, protocol.RESULT_FIELDS + ["valid"], output)
+    else:
+        write_csv(results, protocol.RESULT_FIELDS + ["valid"], sys.stdout)
+    if args.traces:
+        with open(args.traces, "w", newline="") as output:
+            write_csv(samples, protocol.TRACE_FIELDS, output)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+"""Framed binary export protocol of the timer, see src/exporter.h.
+
+Frame: sync "FX", version u8, type u8, sequence u16, length u16, payload, CRC32 (zlib) of
+everything after the sync bytes. All integers are little endian.
+"""
+
+import struct
+import zlib
+
+SYNC = b"FX"
+VERSION = 1
+HEADER = struct.Struct("<2sBBHH")
+
+FRAME_HELLO = 0
+FRAME_RESULT = 1
+FRAME_TRACE = 2
+FRAME_END = 3
+
+HELLO = struct.Struct("<BBI")  # what, record size, baud
+END = struct.Struct("<III")  # frames, results, trace bytes
+
+# JournalRecord (src/journal.h)
+JOURNAL_SPLITS = 8
+RESULT = struct.Struct("<IHHqi%diB7sI" % JOURNAL_SPLITS)
+RESULT_FIELDS = ["sequence", "boot", "run", "start_us", "time_us"] + ["split%d_us" % (i + 1) for i in range(JOURNAL_SPLITS)] + ["flags"]
+
+# RecorderHeader (src/recorder.h)
+RECORDER_MAGIC = 0x31525446
+RECORDER_HEADER = struct.Struct("<IIqII")
+TRACE_FIELDS = ["run", "run_start_us", "time_us", "duration_us", "state"]
+
+
+def encode_frame(frame_type, sequence, payload):
+    header = HEADER.pack(SYNC, VERSION, frame_type, sequence & 0xFFFF, len(payload))
+    crc = zlib.crc32(payload, zlib.crc32(header[2:]))
+    return header + payload + struct.pack("<I", crc)
+
+
+class FrameParser:
+    """Incremental parser, feed() returns the complete frames as (type, sequence, payload)."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.crc_errors = 0
+        self.skipped = 0  # bytes outside of frames (log lines, noise)
+
+    def feed(self, data):
+        self.buffer += data
+        frames = []
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                keep = 1 if self.buffer.endswith(SYNC[:1]) else 0
+                self.skipped += len(self.buffer) - keep
+                del self.buffer[: len(self.buffer) - keep]
+                return frames
+            if start > 0:
+                self.skipped += start
+                del self.buffer[:start]
+            if len(self.buffer) < HEADER.size:
+                return frames
+            _, version, frame_type, sequence, length = HEADER.unpack_from(self.buffer)
+            end = HEADER.size + length + 4
+            if version != VERSION:
+                self.skipped += 1
+                del self.buffer[:1]
+                continue
+            if len(self.buffer) < end:
+                return frames
+            payload = bytes(self.buffer[HEADER.size : end - 4])
+            (crc,) = struct.unpack_from("<I", self.buffer, end - 4)
+            if zlib.crc32(payload, zlib.crc32(bytes(self.buffer[2 : HEADER.size]))) != crc:
+                self.crc_errors += 1
+                self.skipped += 1
+                del self.buffer[:1]  # false sync, search again
+                continue
+            frames.append((frame_type, sequence, payload))
+            del self.buffer[:end]
+
+
+def decode_result(payload):
+    values = RESULT.unpack(payload)
+    result = dict(zip(RESULT_FIELDS, values[: len(RESULT_FIELDS)]))
+    record_crc = values[-1]
+    result["valid"] = zlib.crc32(payload[: RESULT.size - 4]) == record_crc
+    return result
+
+
+def _varint(data, position):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[position]
+        position += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, position
+
+
+def decode_traces(stream):
+    """Decodes the recorder stream (RecorderHeader + delta encoded samples, repeated) into sample dicts."""
+    position = 0
+    samples = []
+    while position + RECORDER_HEADER.size <= len(stream):
+        magic, run, start, count, size = RECORDER_HEADER.unpack_from(stream, position)
+        if magic != RECORDER_MAGIC:
+            raise ValueError("bad trace header at %d" % position)
+        position += RECORDER_HEADER.size
+        end = position + size
+        time = 0
+        duration = 0
+        for _ in range(count):
+            delta, position = _varint(stream, position)
+            zigzag, position = _varint(stream, position)
+            time += delta
+            duration += (zigzag >> 1) ^ -(zigzag & 1)
+            state = stream[position]
+            position += 1
+            samples.append(dict(zip(TRACE_FIELDS, (run, start, time, duration, state))))
+        position = end
+    return samples